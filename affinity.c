@@ -0,0 +1,264 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the CPU and NUMA placement of commands started with the "pin" keyword. A command can be
+ *              pinned to a list of CPUs (e.g. 0-7,16), or to a list of NUMA nodes, in which case it runs on their
+ *              CPUs and its memory is bound to them too; with neither, it goes to the next node with CPUs in turn.
+ *
+ *              The placement is applied to the shell's own thread right before the command's stages are started, and
+ *              undone right after they have been: a child inherits its parent's affinity and memory policy, and
+ *              keeps them across exec, so the stages (and anything they start) run where they're pinned from their
+ *              very first instruction, whether they're spawned or forked.
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // sched_setaffinity, CPU_SET, syscall
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "config.h"
+#include "affinity.h"
+
+#define NODE_DIRECTORY "/sys/devices/system/node"
+#define LIST_SIZE 4096      // enough for any cpulist file the kernel writes
+#define WORD_BITS (8 * sizeof(unsigned long))
+
+static int *cpu_nodes = NULL;     // the nodes that have CPUs, in order; read on first use
+static size_t cpu_node_count = 0;
+static size_t next_node = 0;      // the next node (of cpu_nodes) a command pinned in turn goes to
+
+// the shell thread's placement from before pin_thread(), for unpin_thread()
+static cpu_set_t saved_cpus;
+static int saved_mode = MPOL_DEFAULT;
+static unsigned long saved_nodes[PIN_MAX_NODES / WORD_BITS];
+static bool saved_mempolicy = false;
+
+
+/** ---------------------------------------------------- lists ---------------------------------------------------- */
+
+/**
+ * Parses a list of ids in the kernel's format, i.e. ids and ranges of ids separated by commas, e.g. 0-7,16,18-19.
+ *
+ * @param list the list (null-terminated; may end with a newline)
+ * @param limit one more than the largest id allowed
+ * @param mask a mask of limit bits to set the bit of every id in, or NULL to only check the list
+ * @return true if the list is valid (and has at least one id), false otherwise
+ */
+bool read_id_list(const char* list, size_t limit, unsigned long *mask) {
+    const char *c = list;
+    while (true) {
+        char *end = NULL;
+        if (*c < '0' || *c > '9') {
+            return false;
+        }
+        unsigned long first = strtoul(c, &end, 10);
+        unsigned long last = first;
+        if (*end == '-') {
+            c = end + 1;
+            if (*c < '0' || *c > '9') {
+                return false;
+            }
+            last = strtoul(c, &end, 10);
+        }
+        if (first > last || last >= limit) {
+            return false;
+        }
+        for (unsigned long id = first; mask != NULL && id <= last; id++) {
+            mask[id / WORD_BITS] |= 1UL << (id % WORD_BITS);
+        }
+        c = end;
+        if (*c == ',') {
+            c++;
+        } else {
+            return *c == 0 || (*c == '\n' && c[1] == 0);
+        }
+    }
+}
+
+/**
+ * Returns true if a list given to "pin" is valid: a list of CPUs, or of NUMA nodes.
+ *
+ * @param list the list (null-terminated)
+ * @param nodes true if the list names NUMA nodes, false if it names CPUs
+ */
+bool is_pin_list(const char* list, bool nodes) {
+    return read_id_list(list, nodes ? PIN_MAX_NODES : CPU_SETSIZE, NULL);
+}
+
+/**
+ * Reads a list file of the kernel's, e.g. /sys/devices/system/node/has_cpu.
+ *
+ * @param path the path of the file
+ * @param buffer the buffer to read the list into, with room for LIST_SIZE chars
+ * @return true on success, or false if the file can't be read
+ */
+bool read_list_file(const char* path, char* buffer) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    ssize_t len = read(fd, buffer, LIST_SIZE - 1);
+    close(fd);
+    if (len <= 0) {
+        return false;
+    }
+    buffer[len] = 0;
+    return true;
+}
+
+
+/** ---------------------------------------------------- nodes ---------------------------------------------------- */
+
+/**
+ * Reads the list of nodes that have CPUs, the first time it's needed.
+ *
+ * @return true if there is at least one, false otherwise
+ */
+bool load_cpu_nodes() {
+    if (cpu_node_count > 0) {
+        return true;
+    }
+    char list[LIST_SIZE];
+    unsigned long mask[PIN_MAX_NODES / WORD_BITS] = {0};
+    if (!read_list_file(NODE_DIRECTORY "/has_cpu", list) || !read_id_list(list, PIN_MAX_NODES, mask)) {
+        return false;
+    }
+    cpu_nodes = malloc(PIN_MAX_NODES * sizeof(int));
+    if (cpu_nodes == NULL) {
+        return false;
+    }
+    for (int node = 0; node < PIN_MAX_NODES; node++) {
+        if (mask[node / WORD_BITS] & (1UL << (node % WORD_BITS))) {
+            cpu_nodes[cpu_node_count++] = node;
+        }
+    }
+    return cpu_node_count > 0;
+}
+
+/**
+ * Returns the n-th NUMA node that has CPUs, counting around again past the last one, e.g. for the n-th slot of a
+ * parallel run.
+ *
+ * @param n the position of the node
+ * @return the node, or -1 if the NUMA topology can't be read
+ */
+int get_cpu_node(size_t n) {
+    return load_cpu_nodes() ? cpu_nodes[n % cpu_node_count] : -1;
+}
+
+/**
+ * Adds the CPUs in a mask (as read by read_id_list()) to a CPU set.
+ *
+ * @param mask the mask of CPUs, of CPU_SETSIZE bits
+ * @param cpus the set to add the CPUs to
+ */
+void add_cpus(const unsigned long *mask, cpu_set_t *cpus) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (mask[cpu / WORD_BITS] & (1UL << (cpu % WORD_BITS))) {
+            CPU_SET(cpu, cpus);
+        }
+    }
+}
+
+/**
+ * Adds the CPUs of every node in a mask to a CPU set.
+ *
+ * @param nodes the mask of nodes, of PIN_MAX_NODES bits
+ * @param cpus the set to add the CPUs to
+ * @return true on success, or false if the CPUs of a node can't be read
+ */
+bool add_node_cpus(const unsigned long *nodes, cpu_set_t *cpus) {
+    for (int node = 0; node < PIN_MAX_NODES; node++) {
+        if (!(nodes[node / WORD_BITS] & (1UL << (node % WORD_BITS)))) {
+            continue;
+        }
+        char path[64], list[LIST_SIZE];
+        unsigned long mask[CPU_SETSIZE / WORD_BITS] = {0};
+        snprintf(path, sizeof(path), NODE_DIRECTORY "/node%d/cpulist", node);
+        if (!read_list_file(path, list)) {
+            return false;
+        }
+        if (list[0] == '\n') {
+            continue;  // a node with memory but no CPUs
+        }
+        if (!read_id_list(list, CPU_SETSIZE, mask)) {
+            return false;
+        }
+        add_cpus(mask, cpus);
+    }
+    return true;
+}
+
+
+/** --------------------------------------------------- pinning --------------------------------------------------- */
+
+/**
+ * Pins the shell's thread the way a command is pinned, so that the stages started next inherit it. The thread's
+ * previous placement is saved for unpin_thread().
+ *
+ * @param pinning how the command is pinned (see struct command_pinning)
+ * @return 0 on success, or -1 (after printing an error) if the placement can't be applied, in which case the thread
+ *         is left as it was
+ */
+int pin_thread(const struct command_pinning *pinning) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    unsigned long nodes[PIN_MAX_NODES / WORD_BITS] = {0};
+    const char *reason = NULL;
+
+    if (!pinning->nodes) {
+        unsigned long mask[CPU_SETSIZE / WORD_BITS] = {0};
+        read_id_list(pinning->list, CPU_SETSIZE, mask);
+        add_cpus(mask, &cpus);
+    } else if (pinning->list != NULL) {
+        read_id_list(pinning->list, PIN_MAX_NODES, nodes);
+    } else if (load_cpu_nodes()) {
+        int node = cpu_nodes[next_node++ % cpu_node_count];
+        nodes[node / WORD_BITS] |= 1UL << (node % WORD_BITS);
+    } else {
+        reason = "the NUMA topology can't be read";
+    }
+    if (reason == NULL && pinning->nodes && !add_node_cpus(nodes, &cpus)) {
+        reason = "the CPUs of a node can't be read";
+    }
+
+    saved_mempolicy = false;
+    if (reason == NULL && sched_getaffinity(0, sizeof(saved_cpus), &saved_cpus) == -1) {
+        reason = strerror(errno);
+    }
+    if (reason == NULL && sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+        reason = strerror(errno);
+    }
+    if (reason == NULL && pinning->nodes) {
+        if (syscall(SYS_get_mempolicy, &saved_mode, saved_nodes, PIN_MAX_NODES, NULL, 0) == -1
+            || syscall(SYS_set_mempolicy, MPOL_BIND, nodes, PIN_MAX_NODES + 1) == -1) {
+            reason = strerror(errno);
+            sched_setaffinity(0, sizeof(saved_cpus), &saved_cpus);
+        } else {
+            saved_mempolicy = true;
+        }
+    }
+    if (reason != NULL) {
+        fprintf(stderr, "Error. pin: %s\n", reason);
+        fflush(stderr);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Restores the placement the shell's thread had before the last successful pin_thread().
+ */
+void unpin_thread() {
+    sched_setaffinity(0, sizeof(saved_cpus), &saved_cpus);
+    if (saved_mempolicy) {
+        syscall(SYS_set_mempolicy, saved_mode, saved_mode == MPOL_DEFAULT ? NULL : saved_nodes, PIN_MAX_NODES + 1);
+    }
+}
@@ -0,0 +1,19 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of affinity.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_AFFINITY_H
+#define SMALLSH_AFFINITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "parsers.h"
+
+bool is_pin_list(const char* list, bool nodes);
+int get_cpu_node(size_t n);
+int pin_thread(const struct command_pinning *pinning);
+void unpin_thread();
+
+#endif //SMALLSH_AFFINITY_H
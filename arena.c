@@ -0,0 +1,120 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains a bump (arena) allocator, used for memory that lives exactly as long as one input line.
+ *              Last Modified: 10/14/2026
+ */
+
+#include <stdlib.h>
+#include <stdalign.h>
+#include "arena.h"
+
+
+/**
+ * Allocates a new block with at least size usable bytes.
+ *
+ * @param size the number of usable bytes
+ * @param next the block to chain the new block to (or NULL)
+ * @return a pointer to the block on success, or NULL on failure
+ */
+struct arena_block *create_arena_block(size_t size, struct arena_block *next) {
+    struct arena_block *block = malloc(sizeof(struct arena_block) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/**
+ * Creates an arena whose blocks are at least block_size bytes. The first block is allocated right away, so an arena
+ * that never outgrows it never calls malloc again.
+ *
+ * @param block_size the minimum size of each block, in bytes
+ * @return a pointer to the arena on success, or NULL on failure
+ */
+struct arena *create_arena(size_t block_size) {
+    struct arena *created_arena = malloc(sizeof(struct arena));
+    if (created_arena == NULL) {
+        return NULL;
+    }
+    created_arena->block_size = block_size;
+    created_arena->head = create_arena_block(block_size, NULL);
+    if (created_arena->head == NULL) {
+        free(created_arena);
+        return NULL;
+    }
+    return created_arena;
+}
+
+/**
+ * Allocates size bytes from the arena. The memory is suitably aligned for any type and is *not* zeroed.
+ *
+ * @param arena the arena to allocate from
+ * @param size the number of bytes to allocate
+ * @return a pointer to the allocated memory on success, or NULL on failure
+ */
+void *arena_alloc(struct arena *arena, size_t size) {
+    // round up so that the next allocation stays aligned
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+    // fall back to a new block if this one is full (or if there is none); oversized requests get a block of their own
+    if (arena->head == NULL || arena->head->size - arena->head->used < size) {
+        size_t block_size = size > arena->block_size ? size : arena->block_size;
+        struct arena_block *block = create_arena_block(block_size, arena->head);
+        if (block == NULL) {
+            return NULL;
+        }
+        arena->head = block;
+    }
+
+    void *allocated = (char*) arena->head->data + arena->head->used;
+    arena->head->used += size;
+    return allocated;
+}
+
+/**
+ * Releases everything allocated from the arena so that its memory can be reused. If the arena had to grow, its
+ * blocks are merged into a single block big enough to hold all of them, so the next round of allocations of the
+ * same size is served without calling malloc.
+ *
+ * @param arena the arena to reset
+ */
+void reset_arena(struct arena *arena) {
+    if (arena->head == NULL) {
+        return;
+    }
+    if (arena->head->next == NULL) {
+        arena->head->used = 0;
+        return;
+    }
+
+    size_t total_size = 0;
+    while (arena->head != NULL) {
+        struct arena_block *next = arena->head->next;
+        total_size += arena->head->size;
+        free(arena->head);
+        arena->head = next;
+    }
+    arena->head = create_arena_block(total_size, NULL);
+    if (arena->head == NULL) {
+        // settle for a block of the original size; if even that fails, the arena is left empty and the next
+        // allocation tries again (and reports the failure if it can't get memory either)
+        arena->head = create_arena_block(arena->block_size, NULL);
+    }
+}
+
+/**
+ * Frees the arena and all of its blocks.
+ *
+ * @param arena the arena to delete
+ */
+void delete_arena(struct arena *arena) {
+    while (arena->head != NULL) {
+        struct arena_block *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,44 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of arena.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_ARENA_H
+#define SMALLSH_ARENA_H
+
+#include <stddef.h>
+
+/**
+ * A block of memory owned by an arena. Blocks are chained together when an arena outgrows its first block.
+ *
+ * @property next: the previously allocated block (NULL for the first block)
+ * @property size: the number of usable bytes in data
+ * @property used: the number of bytes in data that have been handed out
+ * @property data: the block's memory
+ */
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+/**
+ * A bump allocator. Memory is handed out with arena_alloc() and is only ever released all at once, either by
+ * reset_arena() (to reuse it) or by delete_arena(). Should be initialized with create_arena()
+ *
+ * @property head: the block currently being allocated from
+ * @property block_size: the minimum size of any block the arena allocates
+ */
+struct arena {
+    struct arena_block *head;
+    size_t block_size;
+};
+
+struct arena *create_arena(size_t block_size);
+void *arena_alloc(struct arena *arena, size_t size);
+void reset_arena(struct arena *arena);
+void delete_arena(struct arena *arena);
+
+#endif //SMALLSH_ARENA_H
@@ -0,0 +1,302 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: A benchmark harness for smallsh's own overhead (built as smallsh_bench). Measures:
+ *                * parse    parse_command() (including expansion) over a corpus of command lines, and
+ *                           parse_cached_command() over the same lines (i.e. mostly from the parse cache)
+ *                * launch   run_command() on /bin/true in the foreground, from launch until it's been reaped
+ *                * reap     how quickly background processes are reaped and reported by the SIGCHLD path
+ *
+ *              Usage: smallsh_bench [-n iterations] [corpus]
+ *                The corpus is a file with one command line per line; without one, a built-in corpus of typical
+ *                lines is used. Results (sample count, mean and percentiles) are printed to stderr.
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // getline
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "smallsh.h"
+#include "error_handlers.h"
+
+#define BENCH_ITERATIONS 1000      // default number of launches (the parser runs 100x that many lines in total)
+#define BENCH_REAP_BATCH 100       // background processes started per round of the reap benchmark
+
+static char *default_corpus[] = {
+    "ls -la",
+    "cd /tmp",
+    "status",
+    "# a comment that should be skipped",
+    "grep -r pattern src > matches.txt",
+    "sort < input.txt > output.txt",
+    "echo pid is $$ in $$.log",
+    "sleep 5 &",
+    "cat access.log | grep GET | sort | uniq -c > counts.txt",
+    "make -j8 all > build.log < /dev/null &",
+    "find . -name *.c -newer Makefile",
+    "tar czf backup-$$.tar.gz docs src include",
+    "   leading   and   trailing   spaces   ",
+    "wc -l file1 file2 file3 file4 file5 file6 file7 file8",
+    NULL
+};
+
+
+/** --------------------------------------------------- samples --------------------------------------------------- */
+
+/**
+ * Returns the current time of the monotonic clock in nanoseconds.
+ */
+long long now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Comparison function for qsort.
+ */
+int compare_samples(const void *a, const void *b) {
+    long long difference = *(const long long*) a - *(const long long*) b;
+    return (difference > 0) - (difference < 0);
+}
+
+/**
+ * Sorts the samples and prints a summary line to stderr, e.g.:
+ *   parse: 140000 samples, mean 180 ns, p50 160 ns, p90 240 ns, p99 610 ns, max 12000 ns
+ *
+ * @param name the name of the benchmark
+ * @param samples the samples, in nanoseconds
+ * @param count the number of samples
+ */
+void print_samples(const char* name, long long *samples, size_t count) {
+    if (count == 0) {
+        fprintf(stderr, "%s: no samples\n", name);
+        return;
+    }
+    qsort(samples, count, sizeof(long long), compare_samples);
+    long long total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += samples[i];
+    }
+    fprintf(stderr, "%s: %zu samples, mean %lld ns, p50 %lld ns, p90 %lld ns, p99 %lld ns, max %lld ns\n",
+        name, count, total / (long long) count, samples[count / 2], samples[count * 9 / 10], samples[count * 99 / 100],
+        samples[count - 1]);
+}
+
+/**
+ * Allocates room for samples.
+ *
+ * @param count the number of samples
+ * @return a pointer to the samples
+ */
+long long *create_samples(size_t count) {
+    long long *samples = malloc(count * sizeof(long long));
+    if (samples == NULL) {
+        handle_memory_error();
+    }
+    return samples;
+}
+
+
+/** -------------------------------------------------- benchmarks ------------------------------------------------- */
+
+/**
+ * Times parse_command() (or parse_cached_command()) on every line of the corpus, over and over. Each line is copied
+ * first, since lines without anything to expand are split in place.
+ *
+ * @param corpus the lines to parse (NULL-terminated)
+ * @param rounds the number of times to parse the whole corpus
+ * @param cached true to parse through the parse cache, false to parse every line from scratch
+ */
+void bench_parse(char **corpus, size_t rounds, bool cached) {
+    size_t line_count = 0;
+    size_t longest = 0;
+    while (corpus[line_count] != NULL) {
+        size_t len = strlen(corpus[line_count]);
+        longest = len > longest ? len : longest;
+        line_count++;
+    }
+
+    long long *samples = create_samples(line_count * rounds);
+    char *line = malloc(longest + 1);
+    struct arena *arena = create_arena(LINE_ARENA_SIZE);
+    if (line == NULL || arena == NULL) {
+        handle_memory_error();
+    }
+
+    size_t count = 0;
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < line_count; i++) {
+            size_t len = strlen(corpus[i]);
+            memcpy(line, corpus[i], len + 1);
+            reset_arena(arena);
+
+            struct command *command;
+            long long start = now_ns();
+            if (cached) {
+                parse_cached_command(line, len, arena, &command);
+            } else {
+                parse_command(line, len, arena, &command);
+            }
+            samples[count++] = now_ns() - start;
+        }
+    }
+    print_samples(cached ? "parse (cached)" : "parse", samples, count);
+
+    delete_arena(arena);
+    free(line);
+    free(samples);
+}
+
+/**
+ * Times run_command() on /bin/true in the foreground, i.e. launching it and waiting for it.
+ *
+ * @param iterations the number of times to run it
+ */
+void bench_launch(size_t iterations) {
+    char *argv[] = { "/bin/true", NULL };
+    struct stage stage = { .argv = argv };
+    struct command command = { .stages = &stage, .stage_count = 1 };
+
+    long long *samples = create_samples(iterations);
+    for (size_t i = 0; i < iterations; i++) {
+        long long start = now_ns();
+        run_command(&command, false);
+        samples[i] = now_ns() - start;
+    }
+    print_samples("launch", samples, iterations);
+    free(samples);
+}
+
+/**
+ * Starts rounds of background /bin/true processes and times how long it takes, per round, until every one of them
+ * has been reaped and reported (divided by the number of processes, so each sample is the cost of one). The
+ * "Background PID" lines go to /dev/null while this runs.
+ *
+ * @param iterations the total number of background processes to start
+ */
+void bench_reap(size_t iterations) {
+    char *argv[] = { "/bin/true", NULL };
+    struct stage stage = { .argv = argv };
+    struct command command = { .stages = &stage, .stage_count = 1, .background = true };
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    sigset_t wait_mask;
+    sigprocmask(SIG_BLOCK, NULL, &wait_mask);
+    sigdelset(&wait_mask, SIGCHLD);
+
+    size_t rounds = (iterations + BENCH_REAP_BATCH - 1) / BENCH_REAP_BATCH;
+    long long *samples = create_samples(rounds);
+    long long total_start = now_ns();
+    for (size_t round = 0; round < rounds; round++) {
+        long long start = now_ns();
+        for (size_t i = 0; i < BENCH_REAP_BATCH; i++) {
+            run_command(&command, true);
+        }
+        size_t reaped = report_child_events();
+        while (reaped < BENCH_REAP_BATCH) {
+            sigsuspend(&wait_mask);
+            reaped += report_child_events();
+        }
+        samples[round] = (now_ns() - start) / BENCH_REAP_BATCH;
+    }
+    long long total = now_ns() - total_start;
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    print_samples("reap (per process)", samples, rounds);
+    fprintf(stderr, "reap: %.0f processes/s\n", (double) (rounds * BENCH_REAP_BATCH) * 1e9 / (double) total);
+    free(samples);
+}
+
+/**
+ * Reads a corpus file into a NULL-terminated array of lines (without their newlines).
+ *
+ * @param file_name the path of the file
+ * @return the lines, or NULL if the file can't be opened
+ */
+char **read_corpus(char* file_name) {
+    FILE *file = fopen(file_name, "re");
+    if (file == NULL) {
+        handle_file_error(file_name, true);
+        return NULL;
+    }
+    size_t count = 0;
+    size_t capacity = 64;
+    char **lines = malloc(capacity * sizeof(char*));
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t len;
+    while (lines != NULL && (len = getline(&line, &line_capacity, file)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = 0;
+        }
+        if (count + 1 == capacity) {
+            capacity *= 2;
+            lines = realloc(lines, capacity * sizeof(char*));
+        }
+        if (lines != NULL && (lines[count++] = strdup(line)) == NULL) {
+            lines = NULL;
+        }
+    }
+    if (lines == NULL) {
+        handle_memory_error();
+    }
+    lines[count] = NULL;
+    free(line);
+    fclose(file);
+    return lines;
+}
+
+/**
+ * Runs the benchmarks.
+ *
+ * @param argc the number of command line arguments
+ * @param argv the command line arguments
+ */
+int main(int argc, char* argv[]) {
+    size_t iterations = BENCH_ITERATIONS;
+    char **corpus = default_corpus;
+    int i = 1;
+    if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+        iterations = strtoul(argv[i + 1], NULL, 10);
+        i += 2;
+    }
+    if (i < argc) {
+        corpus = read_corpus(argv[i]);
+        if (corpus == NULL) {
+            return 1;
+        }
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "Usage: smallsh_bench [-n iterations] [corpus]\n");
+        return 1;
+    }
+
+    // the same environment the shell runs commands in
+    init_smallsh();
+    sigset_t sigchld_set;
+    sigemptyset(&sigchld_set);
+    sigaddset(&sigchld_set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigchld_set, NULL);
+
+    bench_parse(corpus, iterations * 100, false);
+    bench_parse(corpus, iterations * 100, true);
+    bench_launch(iterations);
+    bench_reap(iterations);
+    return 0;
+}
@@ -0,0 +1,556 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the table the shell's built-in commands are dispatched through, and the built-ins that stand
+ *              in for common utilities, so that running them never costs a fork & exec:
+ *                * echo    [-n] [arg ...]
+ *                * true, false
+ *                * test    expression (or [ expression ]), with the POSIX rules for 0 to 4 args
+ *                * pwd
+ *                * export  [name=value ...] (without args, prints the environment)
+ *                * printf  format [arg ...]
+ *
+ *              A built-in only runs in the shell when it's a command of its own (not part of a pipeline); one that
+ *              stands in for a utility is started as the utility when it's run in the background. Redirections of
+ *              stdin, stdout and stderr apply to built-ins too. The utilities set the exit status reported by status.
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // W_EXITCODE, environ
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "commands.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "error_handlers.h"
+#include "builtins.h"
+
+
+/** ---------------------------------------------------- table ---------------------------------------------------- */
+
+/**
+ * The slot of a built-in in the table, from the first and last chars of its name and its length (status and stats
+ * only differ by length). The multipliers were picked (by searching) so that no two built-ins share a slot; the
+ * compiler places every entry, and reports a collision as an error, so adding a built-in that collides means picking
+ * new multipliers (or a new table size).
+ */
+#define BUILTIN_TABLE_SIZE 32
+#define BUILTIN_SLOT(first, last, len) \
+    ((unsigned char) (first) + 16 * (unsigned char) (last) + 3 * (len)) % BUILTIN_TABLE_SIZE
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+static const struct builtin builtin_table[BUILTIN_TABLE_SIZE] = {
+    [BUILTIN_SLOT('c', 'd', 2)] = { "cd", builtin_cd, false },
+    [BUILTIN_SLOT('s', 's', 6)] = { "status", builtin_status, false },
+    [BUILTIN_SLOT('s', 's', 5)] = { "stats", builtin_stats, false },
+    [BUILTIN_SLOT('h', 'h', 4)] = { "hash", builtin_hash, false },
+    [BUILTIN_SLOT('f', 's', 3)] = { "fds", builtin_fds, false },
+    [BUILTIN_SLOT('p', 'l', 8)] = { "parallel", builtin_parallel, false },
+    [BUILTIN_SLOT('j', 's', 4)] = { "jobs", builtin_jobs, false },
+    [BUILTIN_SLOT('w', 't', 4)] = { "wait", builtin_wait, false },
+    [BUILTIN_SLOT('f', 'g', 2)] = { "fg", builtin_fg, false },
+    [BUILTIN_SLOT('e', 'o', 4)] = { "echo", builtin_echo, true },
+    [BUILTIN_SLOT('t', 'e', 4)] = { "true", builtin_true, true },
+    [BUILTIN_SLOT('f', 'e', 5)] = { "false", builtin_false, true },
+    [BUILTIN_SLOT('t', 't', 4)] = { "test", builtin_test, true },
+    [BUILTIN_SLOT('[', '[', 1)] = { "[", builtin_test, true },
+    [BUILTIN_SLOT('p', 'd', 3)] = { "pwd", builtin_pwd, true },
+    [BUILTIN_SLOT('e', 't', 6)] = { "export", builtin_export, false },
+    [BUILTIN_SLOT('p', 'f', 6)] = { "printf", builtin_printf, true },
+};
+#pragma GCC diagnostic pop
+
+
+/**
+ * Finds the built-in with the given name, i.e. the only one that can be in its slot.
+ *
+ * @param name the command name
+ * @return a pointer to the built-in, or NULL if there is none by that name
+ */
+const struct builtin *find_builtin(const char* name) {
+    size_t len = strlen(name);
+    if (len == 0) {
+        return NULL;
+    }
+    const struct builtin *builtin = &builtin_table[BUILTIN_SLOT(name[0], name[len - 1], len)];
+    return builtin->name != NULL && strcmp(builtin->name, name) == 0 ? builtin : NULL;
+}
+
+/**
+ * Points the shell's own stdin, stdout and stderr wherever the stage's redirections say, for the duration of a
+ * built-in. Redirections of other descriptors are ignored, since those belong to the shell.
+ *
+ * @param stage the stage to be run
+ * @param saved_fds pointer to room for three descriptors, to be overwritten with copies of the original stdin, stdout
+ *                  and stderr (or -1 for each one that isn't saved)
+ * @return true on success, or false (with an error message, and nothing redirected) if a file couldn't be opened
+ */
+bool redirect_shell(const struct stage *stage, int *saved_fds) {
+    for (int fd = 0; fd < 3; fd++) {
+        saved_fds[fd] = -1;
+    }
+    if (stage->redirect_count == 0) {
+        return true;
+    }
+    int fd_buffer[REDIRECT_FDS_INLINE];
+    int *redirect_fds = open_redirects(stage, fd_buffer);
+    if (redirect_fds == NULL) {
+        return false;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    for (int fd = 0; fd < 3; fd++) {
+        saved_fds[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+    }
+    for (size_t i = 0; i < stage->redirect_count; i++) {
+        if (stage->redirects[i].fd <= STDERR_FILENO) {
+            dup2(redirect_fds[i], stage->redirects[i].fd);
+        }
+    }
+    close_redirects(stage, redirect_fds, stage->redirect_count, fd_buffer);
+    return true;
+}
+
+/**
+ * Undoes redirect_shell().
+ *
+ * @param saved_fds the descriptors saved by redirect_shell()
+ */
+void restore_shell(const int *saved_fds) {
+    fflush(stdout);
+    fflush(stderr);
+    for (int fd = 0; fd < 3; fd++) {
+        if (saved_fds[fd] != -1) {
+            dup2(saved_fds[fd], fd);
+            close(saved_fds[fd]);
+        }
+    }
+}
+
+/**
+ * Runs the command in the shell if it's a built-in, i.e. if it's a single stage whose command is in the table (and,
+ * for a built-in that stands in for a utility, isn't to be run in the background).
+ *
+ * @param command the parsed command
+ * @param in_background true if the command is to be run in the background, false otherwise
+ * @return true if the command was a built-in (and has been run), false if it should be run as usual
+ */
+bool run_builtin(struct command *command, bool in_background) {
+    if (command->stage_count != 1) {
+        return false;
+    }
+    struct stage *stage = &command->stages[0];
+    const struct builtin *builtin = find_builtin(stage->argv[0]);
+    if (builtin == NULL || (builtin->has_executable && in_background)) {
+        return false;
+    }
+
+    int saved_fds[3];
+    if (!redirect_shell(stage, saved_fds)) {
+        if (builtin->has_executable) {
+            set_exit_status(W_EXITCODE(1, 0));
+        }
+        return true;
+    }
+    builtin->run(stage->argv);
+    restore_shell(saved_fds);
+    return true;
+}
+
+
+/** -------------------------------------------------- utilities -------------------------------------------------- */
+
+/**
+ * Prints the args, separated by spaces and followed by a newline (unless the first arg is "-n").
+ *
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_echo(char** argv) {
+    bool newline = true;
+    char **arg = &argv[1];
+    if (*arg != NULL && strcmp(*arg, "-n") == 0) {
+        newline = false;
+        arg++;
+    }
+    for (char **first = arg; *arg != NULL; arg++) {
+        if (arg != first) {
+            putchar(' ');
+        }
+        fputs(*arg, stdout);
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    fflush(stdout);
+    set_exit_status(W_EXITCODE(0, 0));
+}
+
+/**
+ * Does nothing, successfully.
+ */
+void builtin_true(__attribute__((unused)) char** argv) {
+    set_exit_status(W_EXITCODE(0, 0));
+}
+
+/**
+ * Does nothing, unsuccessfully.
+ */
+void builtin_false(__attribute__((unused)) char** argv) {
+    set_exit_status(W_EXITCODE(1, 0));
+}
+
+/**
+ * Parses an integer operand of test.
+ *
+ * @param string the operand
+ * @param value pointer to where the value is to be stored
+ * @return true on success, or false (with an error message) if the operand isn't an integer
+ */
+bool parse_test_integer(const char* string, long long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoll(string, &end, 10);
+    if (end == string || *end != 0 || errno != 0) {
+        fprintf(stderr, "test: %s: integer expression expected\n", string);
+        fflush(stderr);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Evaluates a unary test, e.g. "-n string" or "-f file".
+ *
+ * @param operator the operator
+ * @param operand the operand
+ * @return 0 if the test is true, 1 if it's false, or 2 if the operator isn't a unary one
+ */
+int test_unary(const char* operator, const char* operand) {
+    if (operator[0] != '-' || operator[1] == 0 || operator[2] != 0) {
+        return 2;
+    }
+    if (operator[1] == 'n' || operator[1] == 'z') {
+        return (operand[0] != 0) == (operator[1] == 'n') ? 0 : 1;
+    }
+
+    struct stat info;
+    bool exists = (operator[1] == 'L' || operator[1] == 'h') ? lstat(operand, &info) == 0 : stat(operand, &info) == 0;
+    switch (operator[1]) {
+        case 'e': return exists ? 0 : 1;
+        case 'f': return exists && S_ISREG(info.st_mode) ? 0 : 1;
+        case 'd': return exists && S_ISDIR(info.st_mode) ? 0 : 1;
+        case 'h':
+        case 'L': return exists && S_ISLNK(info.st_mode) ? 0 : 1;
+        case 's': return exists && info.st_size > 0 ? 0 : 1;
+        case 'r': return access(operand, R_OK) == 0 ? 0 : 1;
+        case 'w': return access(operand, W_OK) == 0 ? 0 : 1;
+        case 'x': return access(operand, X_OK) == 0 ? 0 : 1;
+        default: return 2;
+    }
+}
+
+/**
+ * Evaluates a binary test, e.g. "a = b" or "1 -lt 2".
+ *
+ * @param left the left operand
+ * @param operator the operator
+ * @param right the right operand
+ * @return 0 if the test is true, 1 if it's false, or 2 if the operator isn't a binary one (or an operand isn't an
+ *         integer, with an error message)
+ */
+int test_binary(const char* left, const char* operator, const char* right) {
+    if (strcmp(operator, "=") == 0 || strcmp(operator, "==") == 0) {
+        return strcmp(left, right) == 0 ? 0 : 1;
+    }
+    if (strcmp(operator, "!=") == 0) {
+        return strcmp(left, right) != 0 ? 0 : 1;
+    }
+
+    static const char* const comparisons[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+    for (int i = 0; i < 6; i++) {
+        if (strcmp(operator, comparisons[i]) != 0) {
+            continue;
+        }
+        long long a, b;
+        if (!parse_test_integer(left, &a) || !parse_test_integer(right, &b)) {
+            return 2;
+        }
+        bool results[] = { a == b, a != b, a < b, a <= b, a > b, a >= b };
+        return results[i] ? 0 : 1;
+    }
+    return 2;
+}
+
+/**
+ * Evaluates the args of test (without the closing "]") by their number, as POSIX specifies.
+ *
+ * @param args the args (NULL-terminated)
+ * @param count the number of args
+ * @return 0 if the expression is true, 1 if it's false, or 2 if it's invalid
+ */
+int evaluate_test(char** args, size_t count) {
+    bool negated = count > 1 && strcmp(args[0], "!") == 0;
+    int result;
+    switch (count) {
+        case 0:
+            return 1;
+        case 1:
+            return args[0][0] != 0 ? 0 : 1;
+        case 2:
+            result = negated ? (args[1][0] != 0 ? 0 : 1) : test_unary(args[0], args[1]);
+            break;
+        case 3:
+            result = test_binary(args[0], args[1], args[2]);
+            if (result == 2 && negated) {
+                result = test_unary(args[1], args[2]);
+            } else {
+                negated = false;
+            }
+            break;
+        case 4:
+            result = negated ? test_binary(args[1], args[2], args[3]) : 2;
+            break;
+        default:
+            result = 2;
+    }
+    return result == 2 || !negated ? result : !result;
+}
+
+/**
+ * Evaluates a test expression (see evaluate_test()), and sets the exit status to the result: 0 if it's true, 1 if
+ * it's false, or 2 if it's invalid. As "[", the last arg must be "]".
+ *
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_test(char** argv) {
+    size_t count = 0;
+    while (argv[count + 1] != NULL) {
+        count++;
+    }
+    int result;
+    if (strcmp(argv[0], "[") == 0 && (count == 0 || strcmp(argv[count], "]") != 0)) {
+        fprintf(stderr, "[: missing ]\n");
+        fflush(stderr);
+        result = 2;
+    } else {
+        result = evaluate_test(&argv[1], strcmp(argv[0], "[") == 0 ? count - 1 : count);
+        if (result == 2) {
+            fprintf(stderr, "%s: invalid expression\n", argv[0]);
+            fflush(stderr);
+        }
+    }
+    set_exit_status(W_EXITCODE(result, 0));
+}
+
+/**
+ * Prints the working directory.
+ *
+ * @param argv the parsed argv[] array (including the command); args are ignored
+ */
+void builtin_pwd(__attribute__((unused)) char** argv) {
+    char *directory = getcwd(NULL, 0);
+    if (directory == NULL) {
+        handle_path_error();
+        set_exit_status(W_EXITCODE(1, 0));
+        return;
+    }
+    puts(directory);
+    fflush(stdout);
+    free(directory);
+    set_exit_status(W_EXITCODE(0, 0));
+}
+
+/**
+ * Sets environment variables (inherited by every command run after it) from name=value args. An arg without a value
+ * is accepted but does nothing, since the shell has no variables of its own. Without args, prints the environment.
+ *
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_export(char** argv) {
+    if (argv[1] == NULL) {
+        for (char **variable = environ; *variable != NULL; variable++) {
+            printf("export %s\n", *variable);
+        }
+        fflush(stdout);
+        set_exit_status(W_EXITCODE(0, 0));
+        return;
+    }
+
+    int status = 0;
+    for (int i = 1; argv[i] != NULL; i++) {
+        char *separator = strchr(argv[i], '=');
+        size_t name_len = separator == NULL ? strlen(argv[i]) : (size_t) (separator - argv[i]);
+        bool valid = name_len > 0 && !isdigit((unsigned char) argv[i][0]);
+        for (size_t j = 0; j < name_len && valid; j++) {
+            valid = isalnum((unsigned char) argv[i][j]) || argv[i][j] == '_';
+        }
+        if (!valid) {
+            fprintf(stderr, "export: %s: not a valid name\n", argv[i]);
+            fflush(stderr);
+            status = 1;
+            continue;
+        }
+        if (separator == NULL) {
+            continue;
+        }
+        // the arg can't be split in place, since the command may be shared (see parse_cache.c)
+        char *name = strndup(argv[i], name_len);
+        if (name == NULL || setenv(name, separator + 1, 1) == -1) {
+            report_memory_error();
+            status = 1;
+        }
+        free(name);
+    }
+    set_exit_status(W_EXITCODE(status, 0));
+}
+
+/**
+ * Prints the escape sequence at the start of an escape (just past the '\') of a printf format.
+ *
+ * @param escape pointer to the char after the '\'
+ * @return a pointer to the rest of the format
+ */
+const char *print_escape(const char* escape) {
+    char c;
+    switch (*escape) {
+        case '\\': c = '\\'; break;
+        case 'a': c = '\a'; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'v': c = '\v'; break;
+        default:
+            putchar('\\');  // not an escape, so the '\' is printed as is
+            return escape;
+    }
+    putchar(c);
+    return escape + 1;
+}
+
+/**
+ * Prints a number of a printf conversion, i.e. one of %d, %i, %o, %u, %x or %X.
+ *
+ * @param spec the conversion spec, without the length modifier (room for two more chars is needed)
+ * @param spec_len the length of the spec
+ * @param arg the arg to convert, or NULL for 0
+ * @return true on success, or false (with an error message, and 0 printed) if the arg isn't a number
+ */
+bool print_number(char* spec, size_t spec_len, const char* arg) {
+    char conversion = spec[spec_len - 1];
+    memmove(&spec[spec_len + 1], &spec[spec_len - 1], 2);
+    spec[spec_len - 1] = 'l';
+    spec[spec_len] = 'l';
+
+    long long value = 0;
+    bool valid = true;
+    if (arg != NULL) {
+        char *end;
+        errno = 0;
+        value = arg[0] == '\'' || arg[0] == '"' ? (unsigned char) arg[1] : strtoll(arg, &end, 0);
+        if (arg[0] != '\'' && arg[0] != '"' && (end == arg || *end != 0 || errno != 0)) {
+            fprintf(stderr, "printf: %s: invalid number\n", arg);
+            fflush(stderr);
+            valid = false;
+        }
+    }
+    if (conversion == 'd' || conversion == 'i') {
+        printf(spec, value);
+    } else {
+        printf(spec, (unsigned long long) value);
+    }
+    return valid;
+}
+
+/**
+ * Prints the format once, consuming args for its conversions (missing ones are empty, or 0).
+ *
+ * @param format the format
+ * @param args pointer to the next arg, to be advanced past the args that were consumed
+ * @return true on success, or false (with an error message) if an arg or the format is invalid
+ */
+bool print_format(const char* format, char*** args) {
+    bool valid = true;
+    while (*format != 0) {
+        if (*format == '\\') {
+            format = print_escape(format + 1);
+            continue;
+        }
+        if (*format != '%') {
+            putchar(*format++);
+            continue;
+        }
+        if (format[1] == '%') {
+            putchar('%');
+            format += 2;
+            continue;
+        }
+
+        // copy the spec (flags, width & precision) so that printf itself can do the formatting
+        char spec[PRINTF_SPEC_SIZE];
+        size_t spec_len = 0;
+        const char *start = format++;
+        while (*format != 0 && strchr("-+ #0123456789.", *format) != NULL) {
+            format++;
+        }
+        char conversion = *format;
+        if (conversion == 0 || strchr("diouxXcs", conversion) == NULL
+                || (size_t) (format - start) + 4 > sizeof(spec)) {
+            fprintf(stderr, "printf: %.*s: invalid conversion\n", (int) (format - start + (conversion != 0)), start);
+            fflush(stderr);
+            return false;
+        }
+        format++;
+        spec_len = format - start;
+        memcpy(spec, start, spec_len);
+        spec[spec_len] = 0;
+
+        char *arg = **args;
+        if (arg != NULL) {
+            (*args)++;
+        }
+        if (conversion == 's') {
+            printf(spec, arg != NULL ? arg : "");
+        } else if (conversion == 'c') {
+            printf(spec, arg != NULL ? arg[0] : 0);
+        } else {
+            valid = print_number(spec, spec_len, arg) && valid;
+        }
+    }
+    return valid;
+}
+
+/**
+ * Prints the args according to the format, which supports the usual escapes and the %d, %i, %o, %u, %x, %X, %c, %s
+ * and %% conversions (with flags, width and precision). As long as args remain, the format is used again.
+ *
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_printf(char** argv) {
+    if (argv[1] == NULL) {
+        fprintf(stderr, "printf: missing format\n");
+        fflush(stderr);
+        set_exit_status(W_EXITCODE(1, 0));
+        return;
+    }
+    char **args = &argv[2];
+    bool valid;
+    char **previous;
+    do {
+        previous = args;
+        valid = print_format(argv[1], &args);
+    } while (valid && *args != NULL && args != previous);
+    fflush(stdout);
+    set_exit_status(W_EXITCODE(valid ? 0 : 1, 0));
+}
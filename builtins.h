@@ -0,0 +1,37 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of builtins.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_BUILTINS_H
+#define SMALLSH_BUILTINS_H
+
+#include <stdbool.h>
+#include "parsers.h"
+
+/**
+ * A built-in command.
+ *
+ * @property name: the name it's invoked by
+ * @property run: the function that runs it, given the command's argv[]
+ * @property has_executable: true if it stands in for an executable of the same name (e.g. echo), which is run as
+ *                           usual wherever the built-in can't be, i.e. in the background
+ */
+struct builtin {
+    const char *name;
+    void (*run)(char** argv);
+    bool has_executable;
+};
+
+const struct builtin *find_builtin(const char* name);
+bool run_builtin(struct command *command, bool in_background);
+void builtin_echo(char** argv);
+void builtin_true(char** argv);
+void builtin_false(char** argv);
+void builtin_test(char** argv);
+void builtin_pwd(char** argv);
+void builtin_export(char** argv);
+void builtin_printf(char** argv);
+
+#endif //SMALLSH_BUILTINS_H
@@ -0,0 +1,308 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the cgroup v2 placement of commands started with the "limit" keyword. Each such command gets
+ *              a leaf cgroup of its own, e.g. smallsh-100-3 (the shell's pid and a sequence number), under the cgroup
+ *              named by SMALLSH_CGROUP (see config.h), or else under the shell's own cgroup. The cpu and memory
+ *              controllers are enabled for the leaves as needed, and the limits are written to cpu.max and
+ *              memory.max before anything is started, so a process is limited from its very first instruction.
+ *
+ *              cgroup v2 only lets a cgroup with no processes of its own (other than the root) enable controllers
+ *              for its children, so SMALLSH_CGROUP must name an empty cgroup, delegated to the user; the shell's own
+ *              cgroup is emptied by first moving the shell into a leaf of its own, e.g. smallsh-100-shell, which
+ *              only works if nothing else is in it (e.g. the shell was started in a scope of its own).
+ *
+ *              Leaves can't be removed while any process is still in them, so they're kept on a list, and removed
+ *              once they're empty (see release_job_cgroups()).
+ *              Last Modified: 10/14/2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "cgroups.h"
+
+static char base_path[PATH_MAX];    // the cgroup leaves are created in; empty until it's been found
+static bool cpu_enabled = false;    // whether the base's subtree_control is known to include cpu
+static bool memory_enabled = false;
+static unsigned long next_leaf = 1;
+static unsigned long *leaves = NULL;  // the sequence numbers of the leaves that haven't been removed yet
+static size_t leaf_count = 0;
+static size_t leaf_capacity = 0;
+
+
+/** ---------------------------------------------------- files ---------------------------------------------------- */
+
+/**
+ * Prints an error about a cgroup file (with the reason from errno) to stderr.
+ *
+ * @param path the path of the file or directory
+ */
+void handle_cgroup_error(const char* path) {
+    fprintf(stderr, "Error. limit: %s: %s\n", path, strerror(errno));
+    fflush(stderr);
+}
+
+/**
+ * Writes a path into a buffer, unless it doesn't fit (a truncated path would name some other cgroup).
+ *
+ * @param buffer the buffer, with room for PATH_MAX chars
+ * @param format the printf-style format string
+ * @return true on success, or false (after printing an error) if the path is too long
+ */
+bool format_cgroup_path(char* buffer, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, PATH_MAX, format, args);
+    va_end(args);
+    if (len < 0 || len >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        handle_cgroup_error(buffer);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writes a value to a cgroup interface file, e.g. cpu.max.
+ *
+ * @param directory the path of the cgroup
+ * @param file the name of the file
+ * @param value the value to write
+ * @return true on success, or false (after printing an error) on failure
+ */
+bool write_cgroup_file(const char* directory, const char* file, const char* value) {
+    char path[PATH_MAX];
+    if (!format_cgroup_path(path, "%s/%s", directory, file)) {
+        return false;
+    }
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    size_t len = strlen(value);
+    if (fd == -1 || write(fd, value, len) != (ssize_t) len) {
+        int error = errno;  // kept for the caller, e.g. to tell EBUSY apart
+        handle_cgroup_error(path);
+        if (fd != -1) {
+            close(fd);
+        }
+        errno = error;
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * Moves the shell into a leaf of its own under the cgroup it's in, so that the cgroup is left without processes of
+ * its own. Anything the shell starts later (without limits) starts in the shell's leaf too.
+ *
+ * @param base the path of the shell's cgroup
+ * @return true on success, or false (after printing an error) on failure
+ */
+bool move_shell_to_leaf(const char* base) {
+    char path[PATH_MAX];
+    if (!format_cgroup_path(path, "%s/smallsh-%d-shell", base, (int) getpid())) {
+        return false;
+    }
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        handle_cgroup_error(path);
+        return false;
+    }
+    if (!write_cgroup_file(path, "cgroup.procs", "0")) {
+        rmdir(path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Finds the cgroup the leaves are created in: the value of SMALLSH_CGROUP if it's set, or else the shell's own cgroup
+ * (its entry in the unified hierarchy of /proc/self/cgroup, under CGROUP_ROOT), which the shell moves out of first
+ * (unless it's the root; see move_shell_to_leaf()).
+ *
+ * @return the path of the cgroup, or NULL (after printing an error) if it can't be found
+ */
+const char *find_cgroup_base() {
+    if (base_path[0] != 0) {
+        return base_path;
+    }
+    const char *variable = getenv(CGROUP_VARIABLE);
+    if (variable != NULL && *variable != 0) {
+        if (!format_cgroup_path(base_path, "%s", variable)) {
+            base_path[0] = 0;
+            return NULL;
+        }
+        return base_path;
+    }
+
+    // the unified hierarchy's line is "0::/path"
+    FILE *file = fopen("/proc/self/cgroup", "re");
+    char line[PATH_MAX];
+    char path[PATH_MAX];
+    bool found = false;
+    bool root = false;
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = 0;
+            root = strcmp(&line[3], "/") == 0;
+            found = true;
+            break;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (!found) {
+        fprintf(stderr, "Error. limit: cgroup v2 isn't available (set %s to a cgroup to use)\n", CGROUP_VARIABLE);
+        fflush(stderr);
+        return NULL;
+    }
+    if (!format_cgroup_path(path, "%s%s", CGROUP_ROOT, root ? "" : &line[3])) {
+        return NULL;
+    }
+
+    // the root cgroup is exempt from the rule that a cgroup enabling controllers can't have processes of its own
+    if (!root && !move_shell_to_leaf(path)) {
+        return NULL;
+    }
+    memcpy(base_path, path, sizeof(base_path));
+    return base_path;
+}
+
+/**
+ * Enables a controller for the base's children.
+ *
+ * @param base the path of the base cgroup
+ * @param controller the change to make to cgroup.subtree_control, e.g. "+cpu"
+ * @return true on success, or false (after printing an error) on failure
+ */
+bool enable_controller(const char* base, const char* controller) {
+    if (write_cgroup_file(base, "cgroup.subtree_control", controller)) {
+        return true;
+    }
+    if (errno == EBUSY) {
+        fprintf(stderr, "Error. limit: %s has processes of its own (set %s to an empty cgroup delegated to you)\n",
+                base, CGROUP_VARIABLE);
+        fflush(stderr);
+    }
+    return false;
+}
+
+/**
+ * Enables the controllers the limits need for the base's children, unless they're already known to be enabled.
+ *
+ * @param base the path of the base cgroup
+ * @param limits the limits
+ * @return true on success, or false (after printing an error) on failure
+ */
+bool enable_controllers(const char* base, const struct command_limits *limits) {
+    if (limits->cpu_quota > 0 && !cpu_enabled) {
+        if (!enable_controller(base, "+cpu")) {
+            return false;
+        }
+        cpu_enabled = true;
+    }
+    if (limits->memory_max > 0 && !memory_enabled) {
+        if (!enable_controller(base, "+memory")) {
+            return false;
+        }
+        memory_enabled = true;
+    }
+    return true;
+}
+
+
+/** ---------------------------------------------------- leaves --------------------------------------------------- */
+
+/**
+ * Writes the path of a leaf into a buffer.
+ *
+ * @param buffer the buffer, with room for PATH_MAX chars
+ * @param leaf the leaf's sequence number
+ * @return true on success, or false (after printing an error) if the path is too long
+ */
+bool format_leaf_path(char* buffer, unsigned long leaf) {
+    return format_cgroup_path(buffer, "%s/smallsh-%d-%lu", base_path, (int) getpid(), leaf);
+}
+
+/**
+ * Creates a leaf cgroup with the limits of a command, for every process of the command to be started in.
+ *
+ * @param limits the limits of the command (at least one of them set)
+ * @return a descriptor of the leaf's cgroup.procs (close-on-exec), which a process joins the leaf through by writing
+ *         "0" to it, or -1 (after printing an error) if the leaf couldn't be created
+ */
+int open_job_cgroup(const struct command_limits *limits) {
+    const char *base = find_cgroup_base();
+    if (base == NULL || !enable_controllers(base, limits)) {
+        return -1;
+    }
+    if (leaf_count == leaf_capacity) {
+        size_t capacity = leaf_capacity == 0 ? 16 : leaf_capacity * 2;
+        unsigned long *grown = realloc(leaves, capacity * sizeof(unsigned long));
+        if (grown == NULL) {
+            errno = ENOMEM;
+            handle_cgroup_error(base);
+            return -1;
+        }
+        leaves = grown;
+        leaf_capacity = capacity;
+    }
+
+    unsigned long leaf = next_leaf++;
+    char path[PATH_MAX];
+    if (!format_leaf_path(path, leaf)) {
+        return -1;
+    }
+    if (mkdir(path, 0755) == -1) {
+        handle_cgroup_error(path);
+        return -1;
+    }
+
+    char value[64];
+    bool written = true;
+    if (limits->cpu_quota > 0) {
+        snprintf(value, sizeof(value), "%ld %d", limits->cpu_quota, CGROUP_CPU_PERIOD);
+        written = write_cgroup_file(path, "cpu.max", value);
+    }
+    if (written && limits->memory_max > 0) {
+        snprintf(value, sizeof(value), "%lld", limits->memory_max);
+        written = write_cgroup_file(path, "memory.max", value);
+    }
+    int fd = -1;
+    if (written) {
+        char procs_path[PATH_MAX];
+        if (format_cgroup_path(procs_path, "%s/cgroup.procs", path)
+                && (fd = open(procs_path, O_WRONLY | O_CLOEXEC)) == -1) {
+            handle_cgroup_error(procs_path);
+        }
+    }
+    if (fd == -1) {
+        rmdir(path);
+        return -1;
+    }
+    leaves[leaf_count++] = leaf;
+    return fd;
+}
+
+/**
+ * Removes every leaf whose processes have all exited. Leaves that still have processes in them (e.g. because a
+ * background job is still running) are kept for a later call; a leaf that's gone already is forgotten.
+ */
+void release_job_cgroups() {
+    size_t kept = 0;
+    for (size_t i = 0; i < leaf_count; i++) {
+        // a leaf's path fit when it was created, so it still does
+        char path[PATH_MAX];
+        if (format_leaf_path(path, leaves[i]) && rmdir(path) == -1 && errno == EBUSY) {
+            leaves[kept++] = leaves[i];
+        }
+    }
+    leaf_count = kept;
+}
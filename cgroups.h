@@ -0,0 +1,15 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of cgroups.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_CGROUPS_H
+#define SMALLSH_CGROUPS_H
+
+#include "parsers.h"
+
+int open_job_cgroup(const struct command_limits *limits);
+void release_job_cgroups();
+
+#endif //SMALLSH_CGROUPS_H
@@ -1,35 +1,112 @@
 /*
  * Author: Donato Quartuccia
- * Description: Contains smallsh's built-in commands: exit, cd & status, as well as logic for running other commands
- *              Last Modified 2/8/2022
+ * Description: Contains smallsh's built-in commands: exit, cd, status, hash & fds, as well as logic for running other commands
+ *              (including pipelines, and capturing the output of command substitutions) and keeping track of the status
+ *              and resources used by the last one
+ *              Last Modified 10/14/2026
  */
 
+#define _GNU_SOURCE  // pipe2, environ, wait4, W_EXITCODE, strerrordesc_np
+
 #include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <dirent.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 #include <stdbool.h>
+#include "config.h"
 #include "commands.h"
 #include "signal_handlers.h"
 #include "error_handlers.h"
+#include "path_cache.h"
+#include "jobs.h"
+#include "trace.h"
+#include "cgroups.h"
+#include "affinity.h"
+#include "job_output.h"
+#include "timeouts.h"
 
 
-// exit status of last foreground process
+// exit status and resource usage of last foreground process
 static int exit_status = 0;
 static bool by_signal = false;
+static struct command_usage last_usage = {0};
+
+// latencies of the shell's own work, by phase (see record_phase()); always on, at two clock reads per recording
+static struct phase_stats phase_stats[PHASE_COUNT] = {0};
+static const char *phase_names[PHASE_COUNT] = {
+    [PHASE_STARTUP] = "startup", [PHASE_READ] = "read", [PHASE_EXPAND] = "expand", [PHASE_PARSE] = "parse",
+    [PHASE_LAUNCH] = "launch", [PHASE_RUN] = "run", [PHASE_SIGNAL] = "signal"
+};
+
+// /dev/null, opened once (close-on-exec) and shared by every background stage that isn't redirected
+static int null_fd = -1;
+
+
+/**
+ * Reaps child processes until none are left or until timeout_ms milliseconds have passed, whichever comes first.
+ * SIGCHLD must be blocked by the caller so that it can be waited for synchronously.
+ *
+ * @param timeout_ms the maximum amount of time to wait, in milliseconds
+ */
+void wait_for_children(long timeout_ms) {
+    sigset_t sigchld_set;
+    sigemptyset(&sigchld_set);
+    sigaddset(&sigchld_set, SIGCHLD);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
 
+    // waitpid returns 0 while there are children that are still running, and -1 (ECHILD) once there are none left
+    pid_t child_pid;
+    while ((child_pid = waitpid(-1, NULL, WNOHANG)) >= 0) {
+        if (child_pid > 0) {
+            continue;
+        }
+        struct timespec now, remaining;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+        remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+        if (remaining.tv_nsec < 0) {
+            remaining.tv_sec--;
+            remaining.tv_nsec += 1000000000L;
+        }
+        if (remaining.tv_sec < 0 || (sigtimedwait(&sigchld_set, NULL, &remaining) == -1 && errno == EAGAIN)) {
+            break;  // out of time; whatever is still running will be reparented
+        }
+    }
+}
 
 /**
- * Terminates all processes started by program, then exits the shell
+ * Terminates all background jobs started by the program, each of which is its own process group (so a job's
+ * processes are terminated along with everything they started, and nothing outside of them is), then exits the shell
  */
 void builtin_exit() {
     set_cleanup_signal_handlers();
 
-    // send SIGTERM to every child process and give SIGCHLD time to do cleanup
-    kill(0, SIGTERM);
-    usleep(5000);
+    // send SIGTERM to every child process and wait (up to a deadline) for them to terminate
+    sigset_t sigchld_set;
+    sigemptyset(&sigchld_set);
+    sigaddset(&sigchld_set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigchld_set, NULL);
+
+    signal_jobs(SIGTERM);
+    wait_for_children(EXIT_TIMEOUT_MS);
+    release_job_cgroups();
     exit(0);
 }
 
@@ -46,9 +123,9 @@ void builtin_cd(char** argv) {
 }
 
 /**
- * Prints the exit status of the most recently terminated child process.
+ * Prints the exit status of the most recent foreground process.
  */
-void builtin_status() {
+void print_exit_status() {
     printf(
         "Last foreground process status: %s %d\n",
         by_signal ? "terminated by signal" : "exit value",
@@ -57,83 +134,979 @@ void builtin_status() {
     fflush(stdout);
 }
 
-
 /**
- * Runs the command specified by argv[0] in either foreground or background mode.\n\n
+ * Prints the exit status of the most recent foreground process; with "-v", also prints the resources it used.
  *
- * If run in foreground mode, the shell waits for the command to have finished executing before printing its
- * exit status and returning control. Input and output are not redirected unless specified.\n\n
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_status(char** argv) {
+    print_exit_status();
+    if (argv[1] != NULL && strcmp(argv[1], "-v") == 0) {
+        print_command_usage(stdout, "Resources used", &last_usage);
+    }
+}
+
+
+/**
+ * Prints the command path cache. With "-r", empties it instead; any other args are looked up and added to it.
  *
- * If run in background mode, the shell immediately returns terminal control. Input and output are discarded
- * unless specified.
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_hash(char** argv) {
+    if (argv[1] == NULL) {
+        print_command_paths();
+        return;
+    }
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            clear_command_paths();
+        } else if (lookup_command_path(argv[i]) == NULL) {
+            errno = ENOENT;
+            handle_exec_error(argv[i]);
+        }
+    }
+}
+
+/**
+ * Prints the number of descriptors the shell has open, followed by the descriptors themselves. With "-v", prints what
+ * each of them refers to instead, one per line. For checking that running commands doesn't leak descriptors.
  *
  * @param argv the parsed argv[] array (including the command)
- * @param input_file a string representing the path to the input file (or NULL for default behavior)
- * @param output_file a string representing the path to the output file (or NULL for default behavior)
- * @param in_background true if the command should run in the background, false otherwise
  */
-void run_command(char** argv, char* input_file, char* output_file, bool in_background) {
-    // determine input stream
-    int input_fd = input_file == NULL
-        ? (in_background ? open("/dev/null", O_RDONLY) : STDIN_FILENO)
-        : open(input_file, O_RDONLY);
-    if (input_fd == -1) {
-        // we never attempt to open STDIN; it's conceivable that we could run into an fd limit for /dev/null;
-        handle_file_error(input_file == NULL ? "/dev/null" : input_file, true);
-        exit_status = 1;
+void builtin_fds(char** argv) {
+    bool verbose = argv[1] != NULL && strcmp(argv[1], "-v") == 0;
+    DIR *fd_dir = opendir("/proc/self/fd");
+    if (fd_dir == NULL) {
+        handle_file_error("/proc/self/fd", true);
         return;
     }
 
-    // determine output stream
-    int output_fd = output_file == NULL
-        ? (in_background ? open("/dev/null", O_WRONLY) : STDOUT_FILENO)
-        : open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (output_fd == -1) {
-        // if we opened a file, close it
-        if (input_fd != STDIN_FILENO) {
-            close(input_fd);
+    // the directory's own descriptor is only open while it's being read, so it isn't counted
+    int open_fds[FDS_LIMIT];
+    size_t count = 0;
+    size_t listed = 0;
+    struct dirent *entry;
+    while ((entry = readdir(fd_dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        int fd = atoi(entry->d_name);
+        if (fd == dirfd(fd_dir)) {
+            continue;
+        }
+        if (listed < FDS_LIMIT) {
+            open_fds[listed++] = fd;
+        }
+        count++;
+    }
+    closedir(fd_dir);
+
+    printf("Open descriptors: %zu", count);
+    if (!verbose) {
+        printf(" (");
+        for (size_t i = 0; i < listed; i++) {
+            printf(i == 0 ? "%d" : " %d", open_fds[i]);
+        }
+        printf(count > listed ? " ...)\n" : ")\n");
+    } else {
+        printf("\n");
+        for (size_t i = 0; i < listed; i++) {
+            char link[32], target[256];
+            snprintf(link, sizeof(link), "/proc/self/fd/%d", open_fds[i]);
+            ssize_t len = readlink(link, target, sizeof(target) - 1);
+            target[len == -1 ? 0 : len] = 0;
+            int flags = fcntl(open_fds[i], F_GETFD);
+            printf("%d -> %s%s\n", open_fds[i], target, flags != -1 && (flags & FD_CLOEXEC) ? " (close-on-exec)" : "");
         }
-        // we never attempt to open STDOUT
-        handle_file_error(output_file == NULL ? "/dev/null" : output_file, false);
-        exit_status = 1;
+    }
+    fflush(stdout);
+}
+
+/**
+ * Formats a latency with a unit that keeps it short, e.g. 850ns, 12.3us, 4.56ms or 1.23s.
+ *
+ * @param buffer the buffer to write to
+ * @param size the size of the buffer
+ * @param ns the latency, in nanoseconds
+ */
+void format_latency(char* buffer, size_t size, long long ns) {
+    if (ns < 1000) {
+        snprintf(buffer, size, "%lldns", ns);
+    } else if (ns < 1000000) {
+        snprintf(buffer, size, "%.1fus", ns / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buffer, size, "%.2fms", ns / 1e6);
+    } else {
+        snprintf(buffer, size, "%.2fs", ns / 1e9);
+    }
+}
+
+/**
+ * Returns a percentile of a phase's latencies, from its histogram: the upper bound of the bucket the percentile falls
+ * in (so it's at most twice the real value), or the longest latency if that's lower.
+ *
+ * @param stats the latencies of the phase (at least one of them)
+ * @param percentile the percentile, e.g. 99
+ * @return the percentile, in nanoseconds
+ */
+long long get_phase_percentile(const struct phase_stats *stats, unsigned long percentile) {
+    unsigned long rank = (stats->count * percentile + 99) / 100;
+    unsigned long seen = stats->buckets[0];
+    int bucket = 0;
+    while (bucket < PHASE_BUCKETS - 1 && seen < rank) {
+        seen += stats->buckets[++bucket];
+    }
+    long long bound = 2LL << bucket;
+    return bound < stats->max_ns ? bound : stats->max_ns;
+}
+
+/**
+ * Prints how long the shell's own work has taken, by phase (see enum shell_phase): how often each phase was
+ * recorded, and its total, mean, median, 99th percentile and longest latency. With "-v", also prints each phase's
+ * histogram; with "-r", forgets everything recorded so far instead.
+ *
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_stats(char** argv) {
+    if (argv[1] != NULL && strcmp(argv[1], "-r") == 0) {
+        memset(phase_stats, 0, sizeof(phase_stats));
         return;
     }
+    bool verbose = argv[1] != NULL && strcmp(argv[1], "-v") == 0;
+    printf("%-8s %10s %10s %10s %10s %10s %10s\n", "phase", "count", "total", "mean", "p50", "p99", "max");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        const struct phase_stats *stats = &phase_stats[phase];
+        char total[16] = "-", mean[16] = "-", median[16] = "-", tail[16] = "-", max[16] = "-";
+        if (stats->count > 0) {
+            format_latency(total, sizeof(total), stats->total_ns);
+            format_latency(mean, sizeof(mean), stats->total_ns / (long long) stats->count);
+            format_latency(median, sizeof(median), get_phase_percentile(stats, 50));
+            format_latency(tail, sizeof(tail), get_phase_percentile(stats, 99));
+            format_latency(max, sizeof(max), stats->max_ns);
+        }
+        printf("%-8s %10lu %10s %10s %10s %10s %10s\n",
+            phase_names[phase], stats->count, total, mean, median, tail, max);
+    }
+
+    // one line per bucket that isn't empty, e.g. "  1.0us - 2.0us  17"
+    for (int phase = 0; verbose && phase < PHASE_COUNT; phase++) {
+        const struct phase_stats *stats = &phase_stats[phase];
+        if (stats->count > 0) {
+            printf("%s:\n", phase_names[phase]);
+        }
+        for (int bucket = 0; bucket < PHASE_BUCKETS && stats->count > 0; bucket++) {
+            if (stats->buckets[bucket] > 0) {
+                char low[16], high[16] = "";
+                format_latency(low, sizeof(low), 1LL << bucket);
+                if (bucket < PHASE_BUCKETS - 1) {
+                    format_latency(high, sizeof(high), 2LL << bucket);
+                }
+                printf("  %8s - %-8s %10lu\n", low, high, stats->buckets[bucket]);
+            }
+        }
+    }
+    fflush(stdout);
+}
+
+/**
+ * Records the wait status of the most recent foreground process so that it can be reported by builtin_status().
+ *
+ * @param wait_status the status returned by waitpid()
+ */
+void set_exit_status(int wait_status) {
+    if WIFEXITED(wait_status) {
+        by_signal = false;
+        exit_status = WEXITSTATUS(wait_status);
+    } else {
+        by_signal = true;
+        exit_status = WTERMSIG(wait_status);
+    }
+}
+
+/**
+ * Returns the wait status of the most recent foreground process, in the form returned by waitpid() (so it can be
+ * inspected with WIFEXITED() and friends).
+ */
+int get_exit_status() {
+    return by_signal ? W_EXITCODE(0, exit_status) : W_EXITCODE(exit_status, 0);
+}
+
+/**
+ * Records the wait status of the most recent foreground process so that it can be reported by builtin_status(), and
+ * immediately prints it if the process was terminated by a signal.
+ *
+ * @param wait_status the status returned by waitpid()
+ */
+void record_foreground_status(int wait_status) {
+    set_exit_status(wait_status);
+    if (by_signal) {
+        // immediately print the exit status if the child was terminated
+        putchar('\n');
+        print_exit_status();
+        fflush(stdout);
+    }
+}
+
+/**
+ * Returns the time elapsed between two points in time. Async-signal-safe.
+ *
+ * @param end the later point in time
+ * @param start the earlier point in time
+ * @return end - start
+ */
+struct timespec subtract_timespec(struct timespec end, struct timespec start) {
+    struct timespec elapsed = { end.tv_sec - start.tv_sec, end.tv_nsec - start.tv_nsec };
+    if (elapsed.tv_nsec < 0) {
+        elapsed.tv_sec--;
+        elapsed.tv_nsec += 1000000000L;
+    }
+    return elapsed;
+}
+
+/**
+ * Records the time spent in a phase of the shell's own work, from when it started until now, for builtin_stats().
+ * Async-signal-safe (for the SIGCHLD handler, which can't interrupt another recording, since SIGCHLD is blocked
+ * whenever the shell is working).
+ *
+ * @param phase the phase
+ * @param started_at when the phase started (CLOCK_MONOTONIC)
+ */
+void record_phase(enum shell_phase phase, struct timespec started_at) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct timespec elapsed = subtract_timespec(now, started_at);
+    long long ns = (long long) elapsed.tv_sec * 1000000000LL + elapsed.tv_nsec;
+    if (ns < 1) {
+        ns = 1;
+    }
+    int bucket = 63 - __builtin_clzll((unsigned long long) ns);
+    struct phase_stats *stats = &phase_stats[phase];
+    stats->count++;
+    stats->total_ns += ns;
+    if (ns > stats->max_ns) {
+        stats->max_ns = ns;
+    }
+    stats->buckets[bucket < PHASE_BUCKETS ? bucket : PHASE_BUCKETS - 1]++;
+}
+
+/**
+ * Adds one timeval to another.
+ *
+ * @param total the timeval to add to
+ * @param time the timeval to add
+ */
+void add_timeval(struct timeval *total, const struct timeval *time) {
+    total->tv_sec += time->tv_sec;
+    total->tv_usec += time->tv_usec;
+    if (total->tv_usec >= 1000000L) {
+        total->tv_sec++;
+        total->tv_usec -= 1000000L;
+    }
+}
+
+/**
+ * Adds the resources used by one of a command's processes (as returned by wait4()) to the command's usage; the wall
+ * time isn't touched. Async-signal-safe.
+ *
+ * @param usage the command's usage
+ * @param child_usage the resources used by the process
+ */
+void add_child_usage(struct command_usage *usage, const struct rusage *child_usage) {
+    add_timeval(&usage->user_time, &child_usage->ru_utime);
+    add_timeval(&usage->system_time, &child_usage->ru_stime);
+    if (child_usage->ru_maxrss > usage->max_rss) {
+        usage->max_rss = child_usage->ru_maxrss;
+    }
+}
+
+/**
+ * Combines the usage of commands that ran at the same time: CPU times are added up, while the wall time and max RSS
+ * are those of the longest and largest one.
+ *
+ * @param total the usage to add to
+ * @param usage the usage to add
+ */
+void add_command_usage(struct command_usage *total, const struct command_usage *usage) {
+    add_timeval(&total->user_time, &usage->user_time);
+    add_timeval(&total->system_time, &usage->system_time);
+    if (usage->max_rss > total->max_rss) {
+        total->max_rss = usage->max_rss;
+    }
+    if (usage->wall_time.tv_sec > total->wall_time.tv_sec
+        || (usage->wall_time.tv_sec == total->wall_time.tv_sec && usage->wall_time.tv_nsec > total->wall_time.tv_nsec)) {
+        total->wall_time = usage->wall_time;
+    }
+}
+
+/**
+ * Records the resources used by the most recent foreground command so that they can be reported by builtin_status().
+ *
+ * @param usage the resources used by the command
+ */
+void record_command_usage(const struct command_usage *usage) {
+    last_usage = *usage;
+}
+
+/**
+ * Forgets the resources used by the most recent foreground command, e.g. before running a built-in that may not
+ * start any processes.
+ */
+void clear_command_usage() {
+    memset(&last_usage, 0, sizeof(last_usage));
+}
+
+/**
+ * Prints the resources used by a command on one line, e.g.:
+ *   Resources used: real 1.002s, user 0.004s, sys 0.001s, max RSS 2048 kB
+ *
+ * @param stream the stream to print to
+ * @param label the text the line starts with
+ * @param usage the resources used by the command
+ */
+void print_command_usage(FILE *stream, const char* label, const struct command_usage *usage) {
+    fprintf(stream, "%s: real %ld.%03lds, user %ld.%03lds, sys %ld.%03lds, max RSS %ld kB\n",
+        label,
+        (long) usage->wall_time.tv_sec, usage->wall_time.tv_nsec / 1000000L,
+        (long) usage->user_time.tv_sec, (long) usage->user_time.tv_usec / 1000L,
+        (long) usage->system_time.tv_sec, (long) usage->system_time.tv_usec / 1000L,
+        usage->max_rss);
+    fflush(stream);
+}
+
+/**
+ * Finishes timing a command that was prefixed with "time": the wall time is measured from when the command started,
+ * the CPU times and max RSS are whatever the command recorded, and the result is printed to stderr.
+ *
+ * @param started_at when the command was started (CLOCK_MONOTONIC)
+ */
+void report_command_time(struct timespec started_at) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    last_usage.wall_time = subtract_timespec(now, started_at);
+    fflush(stdout);
+    print_command_usage(stderr, "Time", &last_usage);
+}
+
+/**
+ * Returns the shell's shared /dev/null descriptor (opened for reading and writing), opening it the first time.
+ *
+ * @return the descriptor, or -1 (with an error message) if /dev/null can't be opened
+ */
+int get_null_fd() {
+    if (null_fd == -1) {
+        null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+        if (null_fd == -1) {
+            handle_file_error("/dev/null", false);
+        }
+    }
+    return null_fd;
+}
+
+/**
+ * Closes the files of the first count redirections of a stage.
+ *
+ * @param stage the stage
+ * @param fds the descriptors of its redirections
+ * @param count the number of redirections (from the first) whose files were opened
+ */
+void close_redirect_files(const struct stage *stage, const int *fds, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (stage->redirects[i].type != REDIRECT_DUPLICATE) {
+            close(fds[i]);
+        }
+    }
+}
+
+/**
+ * Closes the files opened by open_redirects(), and frees the descriptors if they didn't fit in the buffer.
+ *
+ * @param stage the stage whose files are to be closed
+ * @param fds the descriptors returned by open_redirects()
+ * @param count the number of redirections (from the first) whose files were opened
+ * @param buffer the buffer that was passed to open_redirects()
+ */
+void close_redirects(const struct stage *stage, int *fds, size_t count, const int *buffer) {
+    close_redirect_files(stage, fds, count);
+    if (fds != buffer) {
+        free(fds);
+    }
+}
+
+/**
+ * Opens the files of a stage's redirections (close-on-exec, since each child only keeps the copies it dup2's). The
+ * stage itself isn't modified, so parsed commands can be shared (see parse_cache.c).
+ *
+ * @param stage the stage whose files are to be opened
+ * @param buffer room for REDIRECT_FDS_INLINE descriptors, which is used if the stage doesn't have more redirections
+ * @return the descriptors to dup2 onto each redirection's fd (its file, or for a duplication, the descriptor it
+ *         copies), to be released with close_redirects(); or NULL (with an error message, and nothing left open) if a
+ *         file couldn't be opened or memory couldn't be allocated
+ */
+int *open_redirects(const struct stage *stage, int *buffer) {
+    int *fds = buffer;
+    if (stage->redirect_count > REDIRECT_FDS_INLINE) {
+        fds = malloc(stage->redirect_count * sizeof(int));
+        if (fds == NULL) {
+            report_memory_error();
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < stage->redirect_count; i++) {
+        const struct redirect *redirect = &stage->redirects[i];
+        if (redirect->type == REDIRECT_DUPLICATE) {
+            fds[i] = redirect->source_fd;
+            continue;
+        }
+        int flags = redirect->type == REDIRECT_INPUT ? O_RDONLY
+            : redirect->type == REDIRECT_APPEND ? O_WRONLY | O_CREAT | O_APPEND
+            : O_WRONLY | O_CREAT | O_TRUNC;
+        fds[i] = open(redirect->file, flags | O_CLOEXEC, 0666);
+        if (fds[i] == -1) {
+            handle_file_error(redirect->file, redirect->type == REDIRECT_INPUT);
+            close_redirects(stage, fds, i, buffer);
+            return NULL;
+        }
+    }
+    return fds;
+}
 
-    // at this point, we can attempt to fork the process
+/**
+ * Builds the argv[] that runs an executable without a #! line as a shell script, the way execvp() does when exec
+ * fails with ENOEXEC: /bin/sh path arg1 arg2 ...
+ *
+ * @param path the path to the executable
+ * @param argv the stage's argv[] (argv[0] is replaced by the path)
+ * @param script_argv room for one more entry than argv (including its NULL), to be overwritten
+ */
+void build_script_argv(const char* path, char** argv, char** script_argv) {
+    script_argv[0] = SCRIPT_SHELL;
+    script_argv[1] = (char*) path;
+    size_t i = 1;
+    do {
+        script_argv[i + 1] = argv[i];
+    } while (argv[i++] != NULL);
+}
+
+/**
+ * Reports an error from a forked child and exits it, e.g. "Error. Command foo not found. No such file or directory".
+ * The message goes out in one write() and the child leaves with _exit(), since it may have been forked while one of
+ * the shell's threads held a lock of stdio (or malloc), and runs no exit handlers that belong to the shell.
+ *
+ * @param message the start of the message
+ * @param subject what the message is about (e.g. the command), or ""
+ * @param separator what goes before the description of the error
+ * @param error the errno value to describe
+ */
+void exit_forked_child(const char* message, const char* subject, const char* separator, int error) {
+    const char *description = strerrordesc_np(error);
+    struct iovec parts[] = {
+        { (char*) message, strlen(message) },
+        { (char*) subject, strlen(subject) },
+        { (char*) separator, strlen(separator) },
+        { (char*) description, description != NULL ? strlen(description) : 0 },
+        { "\n", 1 }
+    };
+    writev(STDERR_FILENO, parts, sizeof(parts) / sizeof(parts[0]));
+    _exit(1);
+}
+
+/**
+ * Returns the number of entries in an argv[], not counting its NULL.
+ */
+size_t count_args(char** argv) {
+    size_t argc = 0;
+    while (argv[argc] != NULL) {
+        argc++;
+    }
+    return argc;
+}
+
+/**
+ * Launches a stage by forking and exec'ing it. This is the fallback for anything spawn_stage() can't express. An
+ * executable without a #! line is run by SCRIPT_SHELL, as execvp() would (see build_script_argv()).
+ *
+ * @param stage the stage to launch
+ * @param path the path to the executable
+ * @param input_fd the descriptor to use as the child's stdin
+ * @param output_fd the descriptor to use as the child's stdout
+ * @param error_fd the descriptor to use as the child's stderr
+ * @param redirect_fds the descriptors of the stage's redirections (see open_redirects())
+ * @param in_background true if the stage is part of a background command, false otherwise
+ * @param placement where to place the child (see struct placement)
+ * @return the pid of the child on success, or -1 (with errno set) if fork failed
+ */
+pid_t fork_stage(const struct stage *stage, const char* path, int input_fd, int output_fd, int error_fd,
+                 const int *redirect_fds, bool in_background, const struct placement *placement) {
     pid_t pid = fork();
-    if (pid == -1) {
-        // fork failed
-        handle_fork_error();
-    } else if (pid == 0) {
-        // child process
+    if (pid == 0) {
+        // child process; it joins its process group and cgroup before anything else, so that it can be signalled
+        // (and is limited) as part of its job from the start
+        if (placement->process_group != -1) {
+            setpgid(0, placement->process_group);
+        }
+        if (placement->cgroup_fd != -1 && write(placement->cgroup_fd, "0", 1) != 1) {
+            exit_forked_child("Error. limit: couldn't join the cgroup", "", ": ", errno);
+        }
         set_child_signal_handlers(in_background);
 
         dup2(input_fd, STDIN_FILENO);
         dup2(output_fd, STDOUT_FILENO);
-        execvp(argv[0], argv);
+        dup2(error_fd, STDERR_FILENO);
+        for (size_t i = 0; i < stage->redirect_count; i++) {
+            dup2(redirect_fds[i], stage->redirects[i].fd);
+        }
+        execv(path, stage->argv);
+        if (errno == ENOEXEC) {
+            char *script_argv[count_args(stage->argv) + 2];  // on the stack, since the shell may have threads
+            build_script_argv(path, stage->argv, script_argv);
+            execv(SCRIPT_SHELL, script_argv);
+        }
 
         // if we get here, it means exec failed
-        handle_exec_error(argv[0]);
-        exit(1);
-    } else {
+        exit_forked_child("Error. Command ", stage->argv[0], " not found. ", errno);
+    }
+
+    // the parent sets the group too, so it's in place whichever of the two gets there first
+    if (pid > 0 && placement->process_group != -1) {
+        setpgid(pid, placement->process_group != 0 ? placement->process_group : pid);
+    }
+    return pid;
+}
+
+/**
+ * Launches a stage with posix_spawn, which avoids copying the shell's page tables. The redirections become file
+ * actions, and the signal dispositions set by set_child_signal_handlers() become spawn attributes: every signal is
+ * unblocked, SIGCHLD (and SIGINT, for foreground stages) is reset to its default, and SIGTSTP stays ignored because
+ * the caller has set_spawn_signal_handlers() in effect. An executable without a #! line is spawned again under
+ * SCRIPT_SHELL, as fork_stage() does. Unlike fork_stage(), an exec failure is reported to the shell itself, and no
+ * child is left behind. The process group is a spawn attribute too, but a cgroup isn't, so a stage that goes in a
+ * cgroup is always forked.
+ *
+ * @param stage the stage to launch
+ * @param path the path to the executable
+ * @param input_fd the descriptor to use as the child's stdin
+ * @param output_fd the descriptor to use as the child's stdout
+ * @param error_fd the descriptor to use as the child's stderr
+ * @param redirect_fds the descriptors of the stage's redirections (see open_redirects())
+ * @param in_background true if the stage is part of a background command, false otherwise
+ * @param placement where to place the child (see struct placement); its cgroup_fd is ignored
+ * @return the pid of the child on success, or -1 (with errno set) on failure
+ */
+pid_t spawn_stage(const struct stage *stage, const char* path, int input_fd, int output_fd, int error_fd,
+                  const int *redirect_fds, bool in_background, const struct placement *placement) {
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    if (input_fd != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&file_actions, input_fd, STDIN_FILENO);
+    }
+    if (output_fd != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&file_actions, output_fd, STDOUT_FILENO);
+    }
+    if (error_fd != STDERR_FILENO) {
+        posix_spawn_file_actions_adddup2(&file_actions, error_fd, STDERR_FILENO);
+    }
+    for (size_t i = 0; i < stage->redirect_count; i++) {
+        posix_spawn_file_actions_adddup2(&file_actions, redirect_fds[i], stage->redirects[i].fd);
+    }
+
+    // background stages keep ignoring SIGINT, which they inherit from the shell
+    sigset_t child_mask, default_signals;
+    sigemptyset(&child_mask);
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGCHLD);
+    if (!in_background) {
+        sigaddset(&default_signals, SIGINT);
+    }
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (placement->process_group != -1) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attributes, placement->process_group);
+    }
+    posix_spawnattr_setflags(&attributes, flags);
+    posix_spawnattr_setsigmask(&attributes, &child_mask);
+    posix_spawnattr_setsigdefault(&attributes, &default_signals);
+
+    pid_t pid;
+    int result = posix_spawn(&pid, path, &file_actions, &attributes, stage->argv, environ);
+    if (result == ENOEXEC) {
+        char **script_argv = malloc((count_args(stage->argv) + 2) * sizeof(char*));
+        if (script_argv != NULL) {
+            build_script_argv(path, stage->argv, script_argv);
+            result = posix_spawn(&pid, SCRIPT_SHELL, &file_actions, &attributes, script_argv, environ);
+            free(script_argv);
+        }
+    }
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    return pid;
+}
+
+/**
+ * Launches a stage with spawn_stage() where possible, or with fork_stage() otherwise. The command is resolved through
+ * the path cache; if a cached path has gone stale, it's dropped and the command is looked up again.
+ *
+ * @param stage the stage to launch
+ * @param input_fd the descriptor to use as the child's stdin
+ * @param output_fd the descriptor to use as the child's stdout
+ * @param error_fd the descriptor to use as the child's stderr
+ * @param redirect_fds the descriptors of the stage's redirections (see open_redirects())
+ * @param in_background true if the stage is part of a background command, false otherwise
+ * @param placement where to place the child (see struct placement)
+ * @return the pid of the child on success, or -1 on failure
+ */
+pid_t launch_stage(const struct stage *stage, int input_fd, int output_fd, int error_fd, const int *redirect_fds,
+                   bool in_background, const struct placement *placement) {
+    char *command = stage->argv[0];
+
+    // flush first so that a child doesn't inherit (and possibly re-print) anything still sitting in the stdout
+    // buffer, which matters in batch mode
+    fflush(stdout);
+
+    pid_t pid = -1;
+    errno = ENOENT;  // in case the command can't be found at all
+    for (int attempt = 0; attempt < 2 && pid == -1; attempt++) {
+        const char *path = lookup_command_path(command);
+        if (path == NULL) {
+            break;
+        }
+        struct timespec launch_start, launch_end;
+        clock_gettime(CLOCK_MONOTONIC, &launch_start);
+        bool spawned = USE_POSIX_SPAWN && placement->cgroup_fd == -1;
+        pid = spawned
+            ? spawn_stage(stage, path, input_fd, output_fd, error_fd, redirect_fds, in_background, placement)
+            : fork_stage(stage, path, input_fd, output_fd, error_fd, redirect_fds, in_background, placement);
+        if (pid != -1) {
+            record_phase(PHASE_LAUNCH, launch_start);
+        }
+        if (pid != -1 && is_tracing()) {
+            clock_gettime(CLOCK_MONOTONIC, &launch_end);
+            trace_launch(pid, path, subtract_timespec(launch_end, launch_start), spawned);
+        }
+
+        // only a cached path can go stale; anything else isn't worth retrying
+        if (pid != -1 || errno != ENOENT || path == command) {
+            break;
+        }
+        forget_command_path(command);
+        errno = ENOENT;
+    }
+
+    if (pid == -1) {
+        // distinguish running out of processes/memory from failing to exec the command
+        if (errno == EAGAIN || errno == ENOMEM) {
+            handle_fork_error();
+        } else {
+            handle_exec_error(command);
+        }
+    }
+    return pid;
+}
+
+/**
+ * Starts every stage of the command (a pipeline of one or more stages) without waiting for any of them. Each stage's
+ * stdout is connected to the next stage's stdin by a pipe. The stages of a foreground command stay in the shell's
+ * process group, so ^C from the terminal reaches every one of them (and they can read from the terminal); those of a
+ * background command are put in a process group of their own, led by the first of them, so that the job can be
+ * signalled as a whole without touching anything else. A stage that can't be started (e.g. because a file can't be
+ * opened) is skipped, and its neighbours see EOF (or SIGPIPE) instead.\n\n
+ *
+ * If the command has limits, its stages are started in a cgroup of their own (see open_job_cgroup()), and if it's
+ * pinned, on the CPUs (and NUMA nodes) it's pinned to (see pin_thread()); if either can't be set up, none of its
+ * stages are started. If it has a timeout (or the shell has a default one), its stages are given a deadline (see
+ * add_group_timeout()): a background job's as a group, or else each stage's of its own (see add_timeout()).\n\n
+ *
+ * Foreground stages read and write the shell's stdin and stdout unless redirected (or connected to a pipe);
+ * background stages use /dev/null instead.
+ *
+ * @param command the parsed command; each stage's redirections take precedence over its pipes
+ * @param in_background true if the command should run in the background, false otherwise
+ * @param output_fd the descriptor the last stage writes to unless redirected, or -1 for the default (see above)
+ * @param error_fd the descriptor every stage's stderr goes to unless redirected, or -1 for the shell's stderr
+ * @param pids pointer to an array with room for one pid per stage, to be overwritten with the pids of the stages
+ *             that were started (in pipeline order)
+ * @param last_started pointer to a bool to be set to true if the last stage was started, false otherwise
+ * @return the number of stages that were started
+ */
+size_t start_command(struct command *command, bool in_background, int output_fd, int error_fd, pid_t *pids,
+                     bool *last_started) {
+    size_t stage_count = command->stage_count;
+
+    struct placement placement = { .process_group = in_background ? 0 : -1, .cgroup_fd = -1 };
+    if (command->limits.cpu_quota > 0 || command->limits.memory_max > 0) {
+        placement.cgroup_fd = open_job_cgroup(&command->limits);
+        if (placement.cgroup_fd == -1) {
+            *last_started = false;
+            return 0;
+        }
+    }
+    bool pinned = command->pinning.list != NULL || command->pinning.nodes;
+    if (pinned && pin_thread(&command->pinning) == -1) {
+        if (placement.cgroup_fd != -1) {
+            close(placement.cgroup_fd);
+        }
+        *last_started = false;
+        return 0;
+    }
+
+    set_spawn_signal_handlers();
+
+    size_t started = 0;
+    *last_started = false;
+    int pipe_read_fd = -1;  // the read end of the pipe coming from the previous stage
+    for (size_t i = 0; i < stage_count; i++) {
+        struct stage *stage = &command->stages[i];
+        bool first = i == 0;
+        bool last = i == stage_count - 1;
+
+        // connect this stage to the next one; the pipe is close-on-exec, so each child only keeps the ends it dup2's
+        int pipe_fds[2] = {-1, -1};
+        if (!last && pipe2(pipe_fds, O_CLOEXEC) == -1) {
+            perror("Error. pipe failed");
+            fflush(stderr);
+            break;
+        }
+
+        // determine the default streams, on top of which the stage's redirections are applied; none of them are
+        // opened just for this stage (the shared /dev/null stays open), so there's nothing else to close afterwards
+        int input_fd = !first ? pipe_read_fd
+            : in_background ? get_null_fd()
+            : STDIN_FILENO;
+        int stage_output_fd = !last ? pipe_fds[1]
+            : output_fd != -1 ? output_fd
+            : in_background ? get_null_fd()
+            : STDOUT_FILENO;
+        int stage_error_fd = error_fd != -1 ? error_fd : STDERR_FILENO;
+
+        // at this point, we can open the redirected files and attempt to start the process; the child has its own
+        // copies of the files once it's started
+        int fd_buffer[REDIRECT_FDS_INLINE];
+        int *redirect_fds = input_fd != -1 && stage_output_fd != -1 ? open_redirects(stage, fd_buffer) : NULL;
+        if (redirect_fds != NULL) {
+            pid_t pid = launch_stage(stage, input_fd, stage_output_fd, stage_error_fd, redirect_fds, in_background,
+                                     &placement);
+            if (pid != -1) {
+                if (placement.process_group == 0) {
+                    placement.process_group = pid;  // the rest of the stages join the first one's group
+                }
+                pids[started] = pid;
+                started++;
+                *last_started = last;
+            }
+            close_redirects(stage, redirect_fds, stage->redirect_count, fd_buffer);
+        }
+
+        // the pipe ends belong to the children now; closing ours lets each stage see EOF (or SIGPIPE) once its
+        // neighbour exits
+        if (pipe_read_fd != -1) {
+            close(pipe_read_fd);
+        }
+        if (pipe_fds[1] != -1) {
+            close(pipe_fds[1]);
+        }
+        pipe_read_fd = pipe_fds[0];
+    }
+    if (pipe_read_fd != -1) {
+        close(pipe_read_fd);  // a later stage failed to start
+    }
+    if (placement.cgroup_fd != -1) {
+        close(placement.cgroup_fd);
+    }
+    if (pinned) {
+        unpin_thread();
+    }
+
+    long timeout_ms = command->timeout_ms != 0 ? command->timeout_ms : get_default_timeout();
+    if (timeout_ms > 0 && started > 0) {
         if (in_background) {
-            // don't wait for the process
-            printf("Background PID %d\n", pid);
-            fflush(stdout);
+            add_group_timeout(pids, started, timeout_ms);
         } else {
-            // wait for the child process to finish and record the exit status
-            waitpid(pid, &exit_status, 0);
-            if WIFEXITED(exit_status) {
-                by_signal = false;
-                exit_status = WEXITSTATUS(exit_status);
-            } else {
-                by_signal = true;
-                exit_status = WTERMSIG(exit_status);
-                // immediately print the exit status if the child was terminated
-                putchar('\n');
-                builtin_status();
-                fflush(stdout);
+            for (size_t i = 0; i < started; i++) {
+                add_timeout(pids[i], timeout_ms);
             }
         }
     }
+
+    restore_signal_handlers_after_spawn();
+
+    return started;
+}
+
+/**
+ * Waits for every stage of a foreground command to finish (serving any deadlines meanwhile; see wait_for_child()),
+ * and records the exit status of the last one (and the resources used by all of them); if the last one couldn't be
+ * started, the command failed.
+ *
+ * @param pids the pids of the stages that were started
+ * @param started the number of stages that were started
+ * @param last_started true if the last stage was started, false otherwise
+ * @param started_at when the command was started (CLOCK_MONOTONIC)
+ */
+void wait_for_command(const pid_t *pids, size_t started, bool last_started, struct timespec started_at) {
+    int wait_status = 0;
+    struct command_usage usage = {0};
+    for (size_t i = 0; i < started; i++) {
+        struct rusage child_usage;
+        pid_t reaped = wait_for_child(pids[i], &wait_status, &child_usage);
+        cancel_timeout(pids[i]);
+        if (reaped != -1) {
+            record_phase(PHASE_RUN, started_at);
+            add_child_usage(&usage, &child_usage);
+            if (is_tracing()) {
+                struct timespec reaped_at;
+                clock_gettime(CLOCK_MONOTONIC, &reaped_at);
+                trace_exit(pids[i], wait_status, &child_usage, reaped_at, false);
+            }
+        }
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usage.wall_time = subtract_timespec(now, started_at);
+    record_command_usage(&usage);
+    if (last_started) {
+        record_foreground_status(wait_status);
+    } else {
+        set_exit_status(W_EXITCODE(1, 0));
+    }
+    release_job_cgroups();
+}
+
+/**
+ * Runs the command (a pipeline of one or more stages) in either foreground or background mode, starting every stage
+ * with start_command().\n\n
+ *
+ * If run in foreground mode, the shell waits for every stage to have finished executing before returning control;
+ * the exit status of the pipeline is that of its last stage. Input and output are not redirected unless specified
+ * (or connected to a pipe).\n\n
+ *
+ * If run in background mode, the shell immediately returns terminal control. Input and output are discarded
+ * unless specified (or connected to a pipe), or with SMALLSH_JOB_OUTPUT set, stdout and stderr are captured and
+ * written out line by line (see job_output.c).
+ *
+ * @param command the parsed command; each stage's redirections take precedence over its pipes
+ * @param in_background true if the command should run in the background, false otherwise
+ * @return 0 once the command has been run (whatever its exit status), or -1 (with errno set to ENOMEM) if memory
+ *         couldn't be allocated, in which case nothing was started
+ */
+int run_command(struct command *command, bool in_background) {
+    pid_t *pids = malloc(command->stage_count * sizeof(pid_t));
+    if (pids == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    // with SMALLSH_JOB_OUTPUT set, a background job's output goes to a pipe of its own instead of /dev/null, and comes
+    // out on the shell's stdout line by line (see job_output.c); the stages hold the only copies of its write end
+    int job_output_fd = -1;
+    if (in_background && is_job_output_captured()) {
+        job_output_fd = open_job_output(get_next_job_number());
+    }
+    bool last_started;
+    size_t started = start_command(command, in_background, job_output_fd, job_output_fd, pids, &last_started);
+    if (job_output_fd != -1) {
+        close(job_output_fd);
+    }
+
+    if (in_background) {
+        // don't wait for the processes, but keep track of them so that they can be waited for later; $! expands to
+        // the pid of the last one
+        add_job(command, pids, started);
+        for (size_t i = 0; i < started; i++) {
+            printf("Background PID %d\n", pids[i]);
+        }
+        if (started > 0) {
+            set_expansion('!', pids[started - 1]);
+        }
+        fflush(stdout);
+    } else {
+        wait_for_command(pids, started, last_started, started_at);
+    }
+
+    free(pids);
+    return 0;
+}
+
+/**
+ * Runs the command in the foreground like run_command(), except that the stdout of its last stage (unless redirected)
+ * is captured instead of going to the shell's stdout, e.g. for a command substitution. The output comes through a
+ * pipe (enlarged to CAPTURE_BLOCK_SIZE where possible), which is read in large blocks as it's written; the stages are
+ * only waited for once it's closed, so they never block on a full pipe.
+ *
+ * @param command the parsed command
+ * @param output where to store a pointer to the output, which is null-terminated and must be freed by the caller
+ * @param output_len where to store the length of the output
+ * @return 0 once the command has been run (whatever its exit status), or -1 (with errno set to ENOMEM) if memory
+ *         couldn't be allocated
+ */
+int capture_command(struct command *command, char **output, size_t *output_len) {
+    pid_t *pids = malloc(command->stage_count * sizeof(pid_t));
+    size_t capacity = CAPTURE_BLOCK_SIZE;
+    char *buffer = malloc(capacity);
+    if (pids == NULL || buffer == NULL) {
+        free(pids);
+        free(buffer);
+        errno = ENOMEM;
+        return -1;
+    }
+    size_t len = 0;
+
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+        perror("Error. pipe failed");
+        fflush(stderr);
+        set_exit_status(W_EXITCODE(1, 0));
+    } else {
+        fcntl(pipe_fds[0], F_SETPIPE_SZ, CAPTURE_BLOCK_SIZE);
+        struct timespec started_at;
+        clock_gettime(CLOCK_MONOTONIC, &started_at);
+        bool last_started;
+        size_t started = start_command(command, false, pipe_fds[1], -1, pids, &last_started);
+        close(pipe_fds[1]);
+
+        // read until every stage holding the write end has exited (or closed it), serving any deadlines in between;
+        // if the buffer can't grow, the read end is closed early, so the stages get SIGPIPE instead of blocking
+        bool failed = false;
+        while (true) {
+            if (len + 1 == capacity) {
+                char *grown = realloc(buffer, capacity * 2);
+                if (grown == NULL) {
+                    failed = true;
+                    break;
+                }
+                buffer = grown;
+                capacity *= 2;
+            }
+            wait_for_readable(pipe_fds[0]);
+            ssize_t count = read(pipe_fds[0], &buffer[len], capacity - len - 1);
+            if (count == -1 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                break;
+            }
+            len += count;
+        }
+        close(pipe_fds[0]);
+        wait_for_command(pids, started, last_started, started_at);
+        if (failed) {
+            free(pids);
+            free(buffer);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    free(pids);
+    buffer[len] = 0;
+    *output = buffer;
+    *output_len = len;
+    return 0;
 }
@@ -1,17 +1,102 @@
 /*
  * Author: Donato Quartuccia
  * Description: Header for public functions of commands.c
- *              Last Modified: 2/3/2022
+ *              Last Modified: 10/14/2026
  */
 
 #ifndef SMALLSH_COMMANDS_H
 #define SMALLSH_COMMANDS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "parsers.h"
+
+/**
+ * The resources used by a command, i.e. by all of its processes together.
+ *
+ * @property wall_time: the time from when the command was started until its last process was reaped
+ * @property user_time: the CPU time its processes spent in user mode
+ * @property system_time: the CPU time its processes spent in the kernel
+ * @property max_rss: the largest maximum resident set size of any of its processes, in kilobytes
+ */
+struct command_usage {
+    struct timespec wall_time;
+    struct timeval user_time;
+    struct timeval system_time;
+    long max_rss;
+};
+
+/**
+ * Where the stages of a command are placed as they're started.
+ *
+ * @property process_group: the process group to put a stage in: -1 => the shell's, 0 => a new one that the stage
+ *                          leads, or otherwise the pgid of the group an earlier stage leads
+ * @property cgroup_fd: a descriptor of cgroup.procs of the cgroup to start a stage in, or -1 => the shell's
+ */
+struct placement {
+    pid_t process_group;
+    int cgroup_fd;
+};
+
+/**
+ * The phases of the shell's own work that are timed (see record_phase()).
+ */
+enum shell_phase {
+    PHASE_STARTUP,      // from main() until the first line can be read
+    PHASE_READ,         // reading a line of input (once it's available)
+    PHASE_EXPAND,       // expanding a line and splitting it into words
+    PHASE_PARSE,        // parsing a line, expansion included ($(command) substitutions not)
+    PHASE_LAUNCH,       // forking or spawning a process
+    PHASE_RUN,          // from starting a process until it's been reaped
+    PHASE_SIGNAL,       // handling SIGCHLD
+    PHASE_COUNT
+};
+
+#define PHASE_BUCKETS 40  // latency buckets per phase; bucket i holds [2^i, 2^(i+1)) ns, the last one anything longer
+
+/**
+ * The latencies recorded for one phase.
+ *
+ * @property count: the number of times the phase was recorded
+ * @property total_ns: the time spent in the phase altogether, in nanoseconds
+ * @property max_ns: the longest time spent in it at once, in nanoseconds
+ * @property buckets: a histogram of the latencies, on a log2 scale (see PHASE_BUCKETS)
+ */
+struct phase_stats {
+    unsigned long count;
+    long long total_ns;
+    long long max_ns;
+    unsigned long buckets[PHASE_BUCKETS];
+};
 
 void builtin_exit();
 void builtin_cd(char** argv);
-void builtin_status();
-void run_command(char** argv, char* input_file, char* output_file, bool in_background);
+void builtin_status(char** argv);
+void builtin_hash(char** argv);
+void builtin_fds(char** argv);
+void builtin_stats(char** argv);
+void set_exit_status(int wait_status);
+int get_exit_status();
+void record_foreground_status(int wait_status);
+struct timespec subtract_timespec(struct timespec end, struct timespec start);
+void record_phase(enum shell_phase phase, struct timespec started_at);
+void add_child_usage(struct command_usage *usage, const struct rusage *child_usage);
+void add_command_usage(struct command_usage *total, const struct command_usage *usage);
+void record_command_usage(const struct command_usage *usage);
+void clear_command_usage();
+void print_command_usage(FILE *stream, const char* label, const struct command_usage *usage);
+void report_command_time(struct timespec started_at);
+int *open_redirects(const struct stage *stage, int *buffer);
+void close_redirects(const struct stage *stage, int *fds, size_t count, const int *buffer);
+size_t start_command(struct command *command, bool in_background, int output_fd, int error_fd, pid_t *pids,
+                     bool *last_started);
+void wait_for_command(const pid_t *pids, size_t started, bool last_started, struct timespec started_at);
+int run_command(struct command *command, bool in_background);
+int capture_command(struct command *command, char **output, size_t *output_len);
 
 #endif //SMALLSH_COMMANDS_H
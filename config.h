@@ -1,18 +1,154 @@
 /*
  * Author: Donato Quartuccia
  * Description: Contains program-wide macro definitions.
- *              Last Modified: 2/8/2022
+ *              Last Modified: 10/14/2026
  */
 
 #ifndef SMALLSH_CONFIG_H
 #define SMALLSH_CONFIG_H
 
-#ifndef MAX_INPUT_CHARS_SIZE
-#define MAX_INPUT_CHARS_SIZE 2050  // 2048 chars + '\n' + null term
-#endif //MAX_INPUT_CHARS_SIZE
+#ifndef LINE_ARENA_SIZE
+#define LINE_ARENA_SIZE 8192       // initial size of the arena backing a parsed line (enough for typical commands)
+#endif //LINE_ARENA_SIZE
 
-#ifndef MAX_ARGV_SIZE
-#define MAX_ARGV_SIZE 514          // 1 command + 512 args + null pointer
-#endif //MAX_ARGV_SIZE
+#ifndef USE_POSIX_SPAWN
+#define USE_POSIX_SPAWN 1          // launch commands with posix_spawnp (0 => always fork + exec)
+#endif //USE_POSIX_SPAWN
+
+#ifndef SCRIPT_SHELL
+#define SCRIPT_SHELL "/bin/sh"     // runs executables without a #! line (when exec fails with ENOEXEC), like execvp
+#endif //SCRIPT_SHELL
+
+#ifndef PATH_CACHE_INITIAL_SIZE
+#define PATH_CACHE_INITIAL_SIZE 64 // initial number of slots in the command path cache (must be a power of two)
+#endif //PATH_CACHE_INITIAL_SIZE
+
+#ifndef DEFAULT_PATH
+#define DEFAULT_PATH "/bin:/usr/bin"  // where commands are searched for if PATH isn't set
+#endif //DEFAULT_PATH
+
+#ifndef EXIT_TIMEOUT_MS
+#define EXIT_TIMEOUT_MS 500        // how long exit waits for children to terminate after sending SIGTERM
+#endif //EXIT_TIMEOUT_MS
+
+#ifndef MAX_JOBS
+#define MAX_JOBS 4096              // the number of background processes the job table can track (must be a power of two)
+#endif //MAX_JOBS
+
+#ifndef JOB_COMMAND_SIZE
+#define JOB_COMMAND_SIZE 64        // the number of chars of a job's command line that are kept for jobs and fg
+#endif //JOB_COMMAND_SIZE
+
+#ifndef CHILD_EVENT_RING_SIZE
+#define CHILD_EVENT_RING_SIZE 1024 // reaped children that can be queued before being reported (must be a power of two)
+#endif //CHILD_EVENT_RING_SIZE
+
+#ifndef CHILD_EVENT_LINE_SIZE
+#define CHILD_EVENT_LINE_SIZE 64   // enough for the longest "Background PID ... is done" line
+#endif //CHILD_EVENT_LINE_SIZE
+
+#ifndef CHILD_EVENT_BATCH_SIZE
+#define CHILD_EVENT_BATCH_SIZE 4096 // the buffer queued child events are formatted into before being written
+#endif //CHILD_EVENT_BATCH_SIZE
+
+#ifndef TRACE_VARIABLE
+#define TRACE_VARIABLE "SMALLSH_TRACE"  // the environment variable that holds the path of the trace file, if any
+#endif //TRACE_VARIABLE
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 65536    // the size of each of the two trace buffers
+#endif //TRACE_BUFFER_SIZE
+
+#ifndef TRACE_FIELD_SIZE
+#define TRACE_FIELD_SIZE 256       // the longest formatted (non-string) part of a trace record
+#endif //TRACE_FIELD_SIZE
+
+#ifndef TRACE_FLUSH_INTERVAL_MS
+#define TRACE_FLUSH_INTERVAL_MS 200  // how often buffered trace records are written out, at the latest
+#endif //TRACE_FLUSH_INTERVAL_MS
+
+#ifndef REDIRECT_FDS_INLINE
+#define REDIRECT_FDS_INLINE 8      // redirections of a stage whose descriptors are kept on the stack (more are malloc'd)
+#endif //REDIRECT_FDS_INLINE
+
+#ifndef FDS_LIMIT
+#define FDS_LIMIT 1024             // the most descriptors the fds built-in lists (all of them are counted)
+#endif //FDS_LIMIT
+
+#ifndef PRINTF_SPEC_SIZE
+#define PRINTF_SPEC_SIZE 32        // the longest conversion spec (e.g. "%-08.3d") the printf built-in accepts
+#endif //PRINTF_SPEC_SIZE
+
+#ifndef PARSE_CACHE_SIZE
+#define PARSE_CACHE_SIZE 256       // lines whose parsed commands are cached (the least recently used one is replaced)
+#endif //PARSE_CACHE_SIZE
+
+#ifndef PARSE_CACHE_LINE_SIZE
+#define PARSE_CACHE_LINE_SIZE 1024 // longer lines aren't cached
+#endif //PARSE_CACHE_LINE_SIZE
+
+#ifndef PARSE_CACHE_ENTRY_SIZE
+#define PARSE_CACHE_ENTRY_SIZE 512 // the initial size of the arena behind each cached line
+#endif //PARSE_CACHE_ENTRY_SIZE
+
+#ifndef SERVER_BACKLOG
+#define SERVER_BACKLOG 64          // connections the server socket queues before they're accepted
+#endif //SERVER_BACKLOG
+
+#ifndef SESSION_STATUS_SIZE
+#define SESSION_STATUS_SIZE 64     // enough for the longest status record sent to a server client
+#endif //SESSION_STATUS_SIZE
+
+#ifndef READER_BLOCK_SIZE
+#define READER_BLOCK_SIZE 65536    // the initial size of the buffer input is read into when it can't be mapped
+#endif //READER_BLOCK_SIZE
+
+#ifndef READER_PREFETCH_SIZE
+#define READER_PREFETCH_SIZE (1 << 20)  // how far ahead of the current line a mapped script is read in
+#endif //READER_PREFETCH_SIZE
+
+#ifndef CAPTURE_BLOCK_SIZE
+#define CAPTURE_BLOCK_SIZE 65536   // the initial size of the buffer (and pipe) command substitution output is read into
+#endif //CAPTURE_BLOCK_SIZE
+
+#ifndef CGROUP_VARIABLE
+#define CGROUP_VARIABLE "SMALLSH_CGROUP"  // the environment variable that holds the cgroup limited jobs are put under
+#endif //CGROUP_VARIABLE
+
+#ifndef CGROUP_ROOT
+#define CGROUP_ROOT "/sys/fs/cgroup"  // where the cgroup v2 hierarchy is mounted
+#endif //CGROUP_ROOT
+
+#ifndef CGROUP_CPU_PERIOD
+#define CGROUP_CPU_PERIOD 100000   // the period of a limited job's CPU quota, in microseconds
+#endif //CGROUP_CPU_PERIOD
+
+#ifndef PIN_MAX_NODES
+#define PIN_MAX_NODES 1024         // one more than the largest NUMA node pin can name (must be a multiple of 64)
+#endif //PIN_MAX_NODES
+
+#ifndef JOB_OUTPUT_VARIABLE
+#define JOB_OUTPUT_VARIABLE "SMALLSH_JOB_OUTPUT"  // if set, background job output is captured and prefixed
+#endif //JOB_OUTPUT_VARIABLE
+
+#ifndef JOB_OUTPUT_LINE_SIZE
+#define JOB_OUTPUT_LINE_SIZE 2048  // the longest line of job output that's written whole (longer ones are split)
+#endif //JOB_OUTPUT_LINE_SIZE
+
+#ifndef JOB_OUTPUT_BATCH_SIZE
+#define JOB_OUTPUT_BATCH_SIZE 4096 // the most job output written at once (PIPE_BUF, so writes are never interleaved)
+#endif //JOB_OUTPUT_BATCH_SIZE
+
+#ifndef JOB_OUTPUT_EVENTS
+#define JOB_OUTPUT_EVENTS 64       // job pipes the writer thread handles per epoll_wait
+#endif //JOB_OUTPUT_EVENTS
+
+#ifndef TIMEOUT_VARIABLE
+#define TIMEOUT_VARIABLE "SMALLSH_TIMEOUT"  // if set, the timeout of commands not started with "timeout" (e.g. 10m)
+#endif //TIMEOUT_VARIABLE
+
+#ifndef TIMEOUT_KILL_DELAY_MS
+#define TIMEOUT_KILL_DELAY_MS 2000 // how long a timed out command has to exit after SIGTERM before it gets SIGKILL
+#endif //TIMEOUT_KILL_DELAY_MS
 
 #endif //SMALLSH_CONFIG_H
@@ -1,7 +1,7 @@
 /*
  * Author: Donato Quartuccia
  * Description: Contains error handlers.
- *              Last Modified: 2/8/2022
+ *              Last Modified: 10/14/2026
  */
 
 #include <stdbool.h>
@@ -12,9 +12,17 @@
 /**
  * Prints an error message to stderr.
  */
-void handle_memory_error() {
+void report_memory_error() {
     perror("Error. Memory allocation failed.\n");
     fflush(stderr);
+}
+
+/**
+ * Prints an error message to stderr and exits. Only used by the shell itself; library functions report the failure
+ * to their caller instead.
+ */
+void handle_memory_error() {
+    report_memory_error();
     exit(1);
 }
 
@@ -1,7 +1,7 @@
 /*
  * Author: Donato Quartuccia
  * Description: Header for public functions of error_handlers.c
- *              Last Modified: 2/4/2022
+ *              Last Modified: 10/14/2026
  */
 
 #ifndef SMALLSH_ERROR_HANDLERS_H
@@ -9,6 +9,7 @@
 
 #include <stdbool.h>
 
+void report_memory_error();
 void handle_memory_error();
 void handle_fork_error();
 void handle_exec_error(char* command);
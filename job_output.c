@@ -0,0 +1,317 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the job output multiplexer. When SMALLSH_JOB_OUTPUT is set (see config.h), the stdout and
+ *              stderr of every background job (unless redirected) go to a pipe of the job's own instead of
+ *              /dev/null, and a writer thread copies whatever comes out of them to the shell's stdout, a whole line at
+ *              a time, with the job's number in front of each line:
+ *                [1] compiling foo.c
+ *                [2] fetching bar.tar.gz
+ *                [1] compiling baz.c
+ *
+ *              The thread waits on every pipe at once with epoll, and collects the lines that are ready into as few
+ *              writes of at most JOB_OUTPUT_BATCH_SIZE (PIPE_BUF) bytes as possible, so lines of different jobs never
+ *              run into each other, even when the shell's stdout is a pipe. A line longer than JOB_OUTPUT_LINE_SIZE
+ *              is split; each job's last line is flushed once the job closes its pipe, newline or not.
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // pipe2
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "config.h"
+#include "error_handlers.h"
+#include "job_output.h"
+
+/**
+ * The read end of one job's pipe, and the part of a line read from it that hasn't been written yet. Once it's been
+ * registered with the epoll instance, it belongs to the writer thread.
+ *
+ * @property fd: the read end of the pipe (non-blocking)
+ * @property number: the job number that prefixes its lines
+ * @property len: the number of bytes in line
+ * @property line: the start of the next line
+ */
+struct job_stream {
+    int fd;
+    size_t number;
+    size_t len;
+    char line[JOB_OUTPUT_LINE_SIZE];
+};
+
+static int epoll_fd = -1;
+static int output_fd = -1;          // the writer's own copy of stdout, which built-ins' redirections don't touch
+static pid_t output_owner = 0;      // the process that owns the writer thread (forked children don't)
+static pthread_t writer;
+
+// the number of pipes that haven't been closed yet, so that exit can wait for the last of the output
+static pthread_mutex_t streams_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t streams_closed;
+static size_t open_streams = 0;
+
+
+/** --------------------------------------------------- writer ---------------------------------------------------- */
+
+/**
+ * Writes all of a batch of lines to the shell's stdout (through output_fd), retrying short writes.
+ *
+ * @param batch the lines
+ * @param len the length of the lines
+ */
+void write_batch(const char* batch, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(output_fd, batch, len);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;  // nowhere to report this; the rest of the batch is dropped
+        }
+        batch += written;
+        len -= written;
+    }
+}
+
+/**
+ * Appends one line of a stream (with its prefix and a newline) to a batch, writing the batch out first if the line
+ * doesn't fit.
+ *
+ * @param batch the batch, with room for JOB_OUTPUT_BATCH_SIZE chars
+ * @param batch_len the length of the batch, to be updated
+ * @param stream the stream the line came from
+ * @param line the line (without its newline)
+ * @param len the length of the line
+ */
+void append_line(char* batch, size_t *batch_len, const struct job_stream *stream, const char* line, size_t len) {
+    char prefix[32];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "[%zu] ", stream->number);
+    if (*batch_len + prefix_len + len + 1 > JOB_OUTPUT_BATCH_SIZE) {
+        write_batch(batch, *batch_len);
+        *batch_len = 0;
+    }
+    memcpy(&batch[*batch_len], prefix, prefix_len);
+    memcpy(&batch[*batch_len + prefix_len], line, len);
+    batch[*batch_len + prefix_len + len] = '\n';
+    *batch_len += prefix_len + len + 1;
+}
+
+/**
+ * Reads what's available from a stream, and appends every line it completes to the batch. Once the pipe is closed
+ * (by every process holding its write end), the last line is appended too, and the stream is deleted.
+ *
+ * @param stream the stream
+ * @param batch the batch, with room for JOB_OUTPUT_BATCH_SIZE chars
+ * @param batch_len the length of the batch, to be updated
+ */
+void drain_stream(struct job_stream *stream, char* batch, size_t *batch_len) {
+    ssize_t count = read(stream->fd, &stream->line[stream->len], JOB_OUTPUT_LINE_SIZE - stream->len);
+    if (count == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (count > 0) {
+        size_t end = stream->len + count;
+        size_t start = 0;
+        char *newline;
+        while ((newline = memchr(&stream->line[start], '\n', end - start)) != NULL) {
+            size_t line_end = newline - stream->line;
+            append_line(batch, batch_len, stream, &stream->line[start], line_end - start);
+            start = line_end + 1;
+        }
+        if (start == 0 && end == JOB_OUTPUT_LINE_SIZE) {
+            append_line(batch, batch_len, stream, stream->line, end);  // too long for one line; split it
+            start = end;
+        }
+        memmove(stream->line, &stream->line[start], end - start);
+        stream->len = end - start;
+        return;
+    }
+
+    // the end of the output (or an error reading it)
+    if (stream->len > 0) {
+        append_line(batch, batch_len, stream, stream->line, stream->len);
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, stream->fd, NULL);
+    close(stream->fd);
+    free(stream);
+    pthread_mutex_lock(&streams_lock);
+    open_streams--;
+    pthread_cond_broadcast(&streams_closed);
+    pthread_mutex_unlock(&streams_lock);
+}
+
+/**
+ * The writer thread: waits for output on any of the pipes, and writes out the lines that come out of them.
+ *
+ * @return NULL
+ */
+void *run_output_writer(__attribute__((unused)) void *unused) {
+    struct epoll_event events[JOB_OUTPUT_EVENTS];
+    char *batch = malloc(JOB_OUTPUT_BATCH_SIZE);
+    if (batch == NULL) {
+        return NULL;
+    }
+    while (true) {
+        int ready = epoll_wait(epoll_fd, events, JOB_OUTPUT_EVENTS, -1);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        size_t batch_len = 0;
+        for (int i = 0; i < ready; i++) {
+            drain_stream(events[i].data.ptr, batch, &batch_len);
+        }
+        write_batch(batch, batch_len);
+    }
+    free(batch);
+    return NULL;
+}
+
+
+/** ---------------------------------------------------- setup ---------------------------------------------------- */
+
+/**
+ * Waits (for up to EXIT_TIMEOUT_MS) for the writer to have written the last of the output of every job whose pipe
+ * is closed by now, e.g. because the job was terminated by exit. Registered with atexit().
+ */
+void finish_job_output() {
+    if (output_owner != getpid()) {
+        return;  // the writer thread belongs to the parent
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += EXIT_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (EXIT_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&streams_lock);
+    while (open_streams > 0 && pthread_cond_timedwait(&streams_closed, &streams_lock, &deadline) == 0) {
+        continue;
+    }
+    pthread_mutex_unlock(&streams_lock);
+}
+
+/**
+ * Creates the epoll instance and starts the writer thread, the first time a job's output is captured (in the process
+ * that's capturing it).
+ *
+ * @return true on success, or false (after printing an error) on failure
+ */
+bool start_output_writer() {
+    if (output_owner == getpid()) {
+        return true;
+    }
+    if (epoll_fd != -1) {
+        close(epoll_fd);  // inherited from the parent, whose writer thread didn't come along
+        close(output_fd);
+    }
+
+    // the writer keeps a copy of stdout as it is now, because a built-in's redirection (see redirect_shell()) points
+    // the shell's own stdout elsewhere while it runs, and a server session's stdout is only its own once it's forked
+    output_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    epoll_fd = output_fd == -1 ? -1 : epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror(output_fd == -1 ? "Error. fcntl failed" : "Error. epoll_create1 failed");
+        fflush(stderr);
+        if (output_fd != -1) {
+            close(output_fd);
+            output_fd = -1;
+        }
+        return false;
+    }
+    pthread_mutex_init(&streams_lock, NULL);  // in case the parent's writer held it when this process was forked
+    pthread_condattr_t closed_attributes;
+    pthread_condattr_init(&closed_attributes);
+    pthread_condattr_setclock(&closed_attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&streams_closed, &closed_attributes);
+    pthread_condattr_destroy(&closed_attributes);
+    open_streams = 0;
+
+    // the writer inherits a fully blocked mask, so every signal is still handled by the main thread
+    sigset_t all_signals, previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous_mask);
+    int result = pthread_create(&writer, NULL, run_output_writer, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+    if (result != 0) {
+        errno = result;
+        perror("Error. pthread_create failed");
+        fflush(stderr);
+        close(epoll_fd);
+        close(output_fd);
+        epoll_fd = -1;
+        output_fd = -1;
+        return false;
+    }
+    if (output_owner == 0) {
+        atexit(finish_job_output);
+    }
+    output_owner = getpid();
+    return true;
+}
+
+/**
+ * Returns true if the output of background jobs is to be captured, i.e. if SMALLSH_JOB_OUTPUT is set.
+ */
+bool is_job_output_captured() {
+    char *value = getenv(JOB_OUTPUT_VARIABLE);
+    return value != NULL && *value != 0;
+}
+
+/**
+ * Creates the pipe a background job's output goes to, and hands its read end to the writer thread.
+ *
+ * @param number the job number, which prefixes every line of the output
+ * @return the write end of the pipe (close-on-exec), for the job's stages to use as stdout and stderr, or -1 (after
+ *         printing an error) if it couldn't be created
+ */
+int open_job_output(size_t number) {
+    if (!start_output_writer()) {
+        return -1;
+    }
+    struct job_stream *stream = malloc(sizeof(struct job_stream));
+    if (stream == NULL) {
+        report_memory_error();
+        return -1;
+    }
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+        perror("Error. pipe failed");
+        fflush(stderr);
+        free(stream);
+        return -1;
+    }
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    stream->fd = pipe_fds[0];
+    stream->number = number;
+    stream->len = 0;
+
+    pthread_mutex_lock(&streams_lock);
+    open_streams++;
+    pthread_mutex_unlock(&streams_lock);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = stream };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stream->fd, &event) == -1) {
+        perror("Error. epoll_ctl failed");
+        fflush(stderr);
+        pthread_mutex_lock(&streams_lock);
+        open_streams--;
+        pthread_mutex_unlock(&streams_lock);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        free(stream);
+        return -1;
+    }
+    return pipe_fds[1];
+}
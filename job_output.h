@@ -0,0 +1,16 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of job_output.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_JOB_OUTPUT_H
+#define SMALLSH_JOB_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool is_job_output_captured();
+int open_job_output(size_t number);
+
+#endif //SMALLSH_JOB_OUTPUT_H
@@ -0,0 +1,596 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the job table, which keeps track of the background processes started by the shell, and the
+ *              jobs, wait & fg built-ins that use it. The table has a fixed capacity so that the SIGCHLD handler can
+ *              update it without allocating: records live in a static array and are found by pid through an
+ *              open-addressed index, so adding, looking up and removing a process never scans the table.
+ *
+ *              The main program only changes the table while SIGCHLD is blocked, and the handler only moves records
+ *              from the running list to the finished list, so the two never see each other's changes half-done.
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // W_EXITCODE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "commands.h"
+#include "error_handlers.h"
+#include "signal_handlers.h"
+#include "timeouts.h"
+#include "jobs.h"
+
+#define NO_JOB -1               // the end of a list of records
+#define INDEX_SIZE (2 * MAX_JOBS)
+#define EMPTY_SLOT 0            // an index slot that has never been used
+#define DELETED_SLOT -1         // an index slot whose record was removed (kept so that probe sequences stay intact)
+
+
+/**
+ * A background process. Every record in use is on exactly one list: the running list (in the order the processes
+ * were started) or the finished list (in the order they were reaped).
+ *
+ * @property pid: the pid of the process
+ * @property last_pid: the pid of the last stage of the pipeline the process belongs to
+ * @property pgid: the process group of the pipeline, i.e. the pid of its first stage
+ * @property number: the job number, shared by every stage of a pipeline
+ * @property wait_status: the status returned by waitpid(), once done
+ * @property started_at: when the process was started (CLOCK_MONOTONIC)
+ * @property usage: the resources used by the process, once done
+ * @property done: true once the process has been reaped
+ * @property last_to_finish: true if every other stage of the job had been reaped by the time this one was
+ * @property foreground: true once fg waits for the process, whose status is then no longer reported as a background
+ *                       process's
+ * @property prev: the previous record in the list; NO_JOB => first
+ * @property next: the next record in the list; NO_JOB => last
+ * @property command: the command line of the job (possibly truncated)
+ */
+struct job {
+    pid_t pid;
+    pid_t last_pid;
+    pid_t pgid;
+    size_t number;
+    int wait_status;
+    struct timespec started_at;
+    struct command_usage usage;
+    volatile sig_atomic_t done;
+    bool last_to_finish;
+    bool foreground;
+    int prev;
+    int next;
+    char command[JOB_COMMAND_SIZE];
+};
+
+/**
+ * A doubly-linked list of records, threaded through their prev and next members.
+ *
+ * @property head: the first record; NO_JOB => empty
+ * @property tail: the last record; NO_JOB => empty
+ */
+struct job_list {
+    int head;
+    int tail;
+};
+
+static struct job jobs[MAX_JOBS];
+static int index_slots[INDEX_SIZE];   // a record's position + 1, EMPTY_SLOT, or DELETED_SLOT; linear probing
+static size_t index_used = 0;         // slots that aren't empty (live records and tombstones)
+static int never_used = 0;            // records from here on have never been handed out
+static int free_records = NO_JOB;     // records that were removed, linked through next
+static struct job_list running = { NO_JOB, NO_JOB };
+static struct job_list finished = { NO_JOB, NO_JOB };
+static size_t next_job_number = 1;
+
+
+/** ---------------------------------------------------- table ---------------------------------------------------- */
+
+/**
+ * Hashes a pid (Knuth's multiplicative hash; consecutive pids land in distinct slots).
+ *
+ * @param pid the pid to hash
+ * @return the hash of the pid
+ */
+uint32_t hash_pid(pid_t pid) {
+    return (uint32_t) pid * 2654435761u;
+}
+
+/**
+ * Finds the index slot that holds the pid, or the slot it would be inserted into if it's not in the table. Only
+ * reads the table, so it's safe to call from a signal handler.
+ *
+ * @param pid the pid to look for
+ * @return the position of the slot
+ */
+size_t find_index_slot(pid_t pid) {
+    size_t first_tombstone = INDEX_SIZE;
+    size_t mask = INDEX_SIZE - 1;
+    for (size_t i = hash_pid(pid) & mask; ; i = (i + 1) & mask) {
+        int slot = index_slots[i];
+        if (slot == EMPTY_SLOT) {
+            return first_tombstone != INDEX_SIZE ? first_tombstone : i;
+        }
+        if (slot == DELETED_SLOT) {
+            if (first_tombstone == INDEX_SIZE) {
+                first_tombstone = i;
+            }
+        } else if (jobs[slot - 1].pid == pid) {
+            return i;
+        }
+    }
+}
+
+/**
+ * Looks up the record of a background process.
+ *
+ * @param pid the pid of the process
+ * @return a pointer to the record, or NULL if the process isn't in the table
+ */
+struct job *find_job(pid_t pid) {
+    int slot = index_slots[find_index_slot(pid)];
+    return slot > 0 ? &jobs[slot - 1] : NULL;
+}
+
+/**
+ * Appends a record to a list.
+ *
+ * @param list the list
+ * @param record the position of the record
+ */
+void link_job(struct job_list *list, int record) {
+    jobs[record].prev = list->tail;
+    jobs[record].next = NO_JOB;
+    if (list->tail != NO_JOB) {
+        jobs[list->tail].next = record;
+    } else {
+        list->head = record;
+    }
+    list->tail = record;
+}
+
+/**
+ * Removes a record from the list it's on.
+ *
+ * @param list the list
+ * @param record the position of the record
+ */
+void unlink_job(struct job_list *list, int record) {
+    struct job *job = &jobs[record];
+    if (job->prev != NO_JOB) {
+        jobs[job->prev].next = job->next;
+    } else {
+        list->head = job->next;
+    }
+    if (job->next != NO_JOB) {
+        jobs[job->next].prev = job->prev;
+    } else {
+        list->tail = job->prev;
+    }
+}
+
+/**
+ * Re-inserts every record into an empty index, which clears out the tombstones.
+ */
+void rebuild_index() {
+    memset(index_slots, 0, sizeof(index_slots));
+    index_used = 0;
+    struct job_list *lists[] = { &running, &finished };
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        for (int record = lists[i]->head; record != NO_JOB; record = jobs[record].next) {
+            index_slots[find_index_slot(jobs[record].pid)] = record + 1;
+            index_used++;
+        }
+    }
+}
+
+/**
+ * Removes a record from the table and recycles it.
+ *
+ * @param job a pointer to the record
+ */
+void remove_job(struct job *job) {
+    int record = (int) (job - jobs);
+    unlink_job(job->done ? &finished : &running, record);
+    index_slots[find_index_slot(job->pid)] = DELETED_SLOT;
+    job->next = free_records;
+    free_records = record;
+
+    // numbering starts over once there are no jobs left
+    if (running.head == NO_JOB && finished.head == NO_JOB) {
+        next_job_number = 1;
+    }
+}
+
+/**
+ * Hands out an unused record. If there are none left, the process that was reaped the longest time ago is forgotten.
+ *
+ * @return the position of the record, or NO_JOB if every record belongs to a process that is still running
+ */
+int allocate_record() {
+    if (free_records == NO_JOB) {
+        if (never_used < MAX_JOBS) {
+            return never_used++;
+        }
+        if (finished.head == NO_JOB) {
+            return NO_JOB;
+        }
+        remove_job(&jobs[finished.head]);
+    }
+    int record = free_records;
+    free_records = jobs[record].next;
+    return record;
+}
+
+/**
+ * Writes a command line into a buffer, e.g. "sleep 5 | cat". Redirections aren't included, and the command line is
+ * truncated if it doesn't fit.
+ *
+ * @param command the command
+ * @param buffer the buffer to write to
+ * @param size the size of buffer
+ */
+void format_command(struct command *command, char* buffer, size_t size) {
+    size_t len = 0;
+    buffer[0] = 0;
+    for (size_t i = 0; i < command->stage_count; i++) {
+        for (char **arg = command->stages[i].argv; *arg != NULL; arg++) {
+            const char *separator = arg != command->stages[i].argv ? " " : i > 0 ? " | " : "";
+            int written = snprintf(&buffer[len], size - len, "%s%s", separator, *arg);
+            if (written < 0 || (size_t) written >= size - len) {
+                return;
+            }
+            len += written;
+        }
+    }
+}
+
+/**
+ * Returns the number the next job added to the table will get.
+ */
+size_t get_next_job_number() {
+    return next_job_number;
+}
+
+/**
+ * Adds the processes of a background command to the table, as one job. SIGCHLD must be blocked by the caller from
+ * before the processes are started, so that none of them can be reaped before it's been added.
+ *
+ * @param command the command the processes were started for
+ * @param pids the pids of the processes that were started
+ * @param count the number of entries in pids
+ */
+void add_job(struct command *command, pid_t *pids, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    char command_line[JOB_COMMAND_SIZE];
+    format_command(command, command_line, sizeof(command_line));
+    size_t number = next_job_number++;
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    for (size_t i = 0; i < count; i++) {
+        // a finished process's pid may have been reused by the kernel
+        struct job *stale = find_job(pids[i]);
+        if (stale != NULL) {
+            remove_job(stale);
+        }
+
+        int record = allocate_record();
+        if (record == NO_JOB) {
+            fprintf(stderr, "Error. Job table is full; PID %d won't be tracked\n", pids[i]);
+            fflush(stderr);
+            continue;
+        }
+        if (index_used >= INDEX_SIZE / 4 * 3) {
+            rebuild_index();
+        }
+
+        struct job *job = &jobs[record];
+        job->pid = pids[i];
+        job->last_pid = pids[count - 1];
+        job->pgid = pids[0];
+        job->number = number;
+        job->wait_status = 0;
+        job->started_at = started_at;
+        memset(&job->usage, 0, sizeof(job->usage));
+        job->done = false;
+        job->last_to_finish = false;
+        job->foreground = false;
+        memcpy(job->command, command_line, sizeof(command_line));
+
+        size_t slot = find_index_slot(job->pid);
+        if (index_slots[slot] == EMPTY_SLOT) {
+            index_used++;
+        }
+        index_slots[slot] = record + 1;
+        link_job(&running, record);
+    }
+}
+
+/**
+ * Records that a background process was reaped. The record is kept (on the finished list) until its status has been
+ * collected by wait, fg or jobs. Async-signal-safe; does nothing if the process isn't in the table.
+ *
+ * @param pid the pid of the process
+ * @param wait_status the status returned by wait4()
+ * @param child_usage the resources used by the process, as returned by wait4()
+ * @param reaped_at when the process was reaped (CLOCK_MONOTONIC)
+ */
+void mark_job_done(pid_t pid, int wait_status, const struct rusage *child_usage, struct timespec reaped_at) {
+    struct job *job = find_job(pid);
+    if (job == NULL || job->done) {
+        return;
+    }
+    int record = (int) (job - jobs);
+
+    // the stages of a job are next to each other on the running list, so it's done once neither neighbour is its own
+    job->last_to_finish = (job->prev == NO_JOB || jobs[job->prev].number != job->number)
+        && (job->next == NO_JOB || jobs[job->next].number != job->number);
+    unlink_job(&running, record);
+    job->wait_status = wait_status;
+    add_child_usage(&job->usage, child_usage);
+    job->usage.wall_time = subtract_timespec(reaped_at, job->started_at);
+    job->done = true;
+    record_phase(PHASE_RUN, job->started_at);
+    link_job(&finished, record);
+}
+
+/**
+ * Sends a signal to every background job that's still running, i.e. to the process group of each one (which holds
+ * every stage of the job, and anything they've started). Must be called with SIGCHLD blocked, so that no group's
+ * last process can be reaped (and its pgid reused) in the meantime.
+ *
+ * @param signal_number the signal to send
+ */
+void signal_jobs(int signal_number) {
+    // the stages of a job are next to each other on the running list, so each group is only signalled once
+    size_t number = 0;
+    for (int record = running.head; record != NO_JOB; record = jobs[record].next) {
+        if (jobs[record].number != number) {
+            number = jobs[record].number;
+            kill(-jobs[record].pgid, signal_number);
+        }
+    }
+}
+
+/**
+ * Returns true if a background job led by a process group is still running, i.e. if it's safe to signal the group
+ * (see signal_jobs()). Each stage is looked up through the index, so the table is never scanned.
+ *
+ * @param pgid the process group of the job
+ * @param pids the pids of the job's stages
+ * @param count the number of stages
+ */
+bool is_job_group_running(pid_t pgid, const pid_t *pids, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        // a later job that reused the pid has a record of its own, in another group
+        struct job *job = find_job(pids[i]);
+        if (job != NULL && !job->done && job->pgid == pgid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns true if a process belongs to a job that fg brought to the foreground, i.e. if its status is reported by fg
+ * instead of as a background process's.
+ *
+ * @param pid the pid of the process
+ */
+bool is_foreground_job(pid_t pid) {
+    struct job *job = find_job(pid);
+    return job != NULL && job->foreground;
+}
+
+/**
+ * Cancels the deadline of a background job (see cancel_group_timeout()) once a process that was its last stage to
+ * finish has been reaped, so that finished jobs don't keep their deadlines until they pass. Must be called with
+ * SIGCHLD blocked.
+ *
+ * @param pid the pid of the process that was reaped
+ */
+void release_job_timeout(pid_t pid) {
+    struct job *job = find_job(pid);
+    if (job != NULL && job->done && job->last_to_finish && has_timeouts()) {
+        cancel_group_timeout(job->pgid);
+    }
+}
+
+
+/** -------------------------------------------------- builtins -------------------------------------------------- */
+
+/**
+ * Suspends the shell until a process has been reaped (serving any deadlines meanwhile; see suspend_for_child()).
+ * SIGCHLD must be blocked by the caller; it's unblocked only while the shell is suspended, so the handler can't run
+ * between checking the record and going to sleep.
+ *
+ * @param job a pointer to the process's record
+ */
+void wait_until_done(struct job *job) {
+    sigset_t wait_mask;
+    sigprocmask(SIG_BLOCK, NULL, &wait_mask);
+    sigdelset(&wait_mask, SIGCHLD);
+    while (!job->done) {
+        suspend_for_child(&wait_mask);
+        report_child_events();  // also makes room on the ring if the handler ran out
+    }
+}
+
+/**
+ * Looks up the record of a process named by a built-in's arg, printing an error if there isn't one.
+ *
+ * @param arg the arg (a pid)
+ * @param builtin the name of the built-in, for messages
+ * @return a pointer to the record, or NULL if the arg isn't the pid of a process in the table
+ */
+struct job *find_job_arg(const char* arg, const char* builtin) {
+    char *arg_end = NULL;
+    long pid = strtol(arg, &arg_end, 10);
+    if (*arg == 0 || *arg_end != 0 || pid <= 0) {
+        fprintf(stderr, "Error. %s: %s is not a pid\n", builtin, arg);
+        fflush(stderr);
+        return NULL;
+    }
+    struct job *job = find_job((pid_t) pid);
+    if (job == NULL) {
+        fprintf(stderr, "Error. %s: PID %ld is not a background process of this shell\n", builtin, pid);
+        fflush(stderr);
+    }
+    return job;
+}
+
+/**
+ * Prints one line for a process in the table, e.g.:
+ *   [1] PID 1234 (running) sleep 5 | cat
+ *
+ * @param job a pointer to the process's record
+ */
+void print_job(struct job *job) {
+    if (!job->done) {
+        printf("[%zu] PID %d (running) %s\n", job->number, job->pid, job->command);
+    } else if (WIFSIGNALED(job->wait_status)) {
+        printf("[%zu] PID %d (terminated by signal %d) %s\n",
+            job->number, job->pid, WTERMSIG(job->wait_status), job->command);
+    } else {
+        printf("[%zu] PID %d (exit value %d) %s\n",
+            job->number, job->pid, WEXITSTATUS(job->wait_status), job->command);
+    }
+}
+
+/**
+ * Lists the background processes that are still running, followed by the ones that finished since they were last
+ * listed or waited for. Finished processes are forgotten once they've been listed.
+ *
+ * @param argv the parsed argv[] array (including the command); args are ignored
+ */
+void builtin_jobs(__attribute__((unused)) char** argv) {
+    for (int record = running.head; record != NO_JOB; record = jobs[record].next) {
+        print_job(&jobs[record]);
+    }
+    while (finished.head != NO_JOB) {
+        print_job(&jobs[finished.head]);
+        remove_job(&jobs[finished.head]);
+    }
+    fflush(stdout);
+}
+
+/**
+ * Waits for background processes to finish. Without args, waits for all of them (and the exit status is 0);
+ * otherwise, waits for each pid in turn, and the exit status is that of the last one (127 if it's not a background
+ * process of this shell). The resources used by the processes that were waited for are recorded for status -v.
+ *
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_wait(char** argv) {
+    if (argv[1] == NULL) {
+        sigset_t wait_mask;
+        sigprocmask(SIG_BLOCK, NULL, &wait_mask);
+        sigdelset(&wait_mask, SIGCHLD);
+        while (running.head != NO_JOB) {
+            suspend_for_child(&wait_mask);
+            report_child_events();
+        }
+        struct command_usage usage = {0};
+        while (finished.head != NO_JOB) {
+            add_command_usage(&usage, &jobs[finished.head].usage);
+            remove_job(&jobs[finished.head]);
+        }
+        set_exit_status(W_EXITCODE(0, 0));
+        record_command_usage(&usage);
+        return;
+    }
+
+    int wait_status = W_EXITCODE(0, 0);
+    struct command_usage usage = {0};
+    for (int i = 1; argv[i] != NULL; i++) {
+        struct job *job = find_job_arg(argv[i], "wait");
+        if (job == NULL) {
+            wait_status = W_EXITCODE(127, 0);
+            continue;
+        }
+        wait_until_done(job);
+        wait_status = job->wait_status;
+        add_command_usage(&usage, &job->usage);
+        remove_job(job);
+    }
+    set_exit_status(wait_status);
+    record_command_usage(&usage);
+}
+
+/**
+ * Waits for a background job as if it were running in the foreground: the command line is printed, and its status
+ * (that of its last stage) is reported and recorded like a foreground process's. Defaults to the most recently
+ * started job that is still running; with a pid, waits for the job that process belongs to. The job keeps ignoring
+ * SIGINT, since that was set when it was started.
+ *
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_fg(char** argv) {
+    struct job *job;
+    if (argv[1] == NULL) {
+        if (running.tail == NO_JOB) {
+            fprintf(stderr, "Error. fg: no current job\n");
+            fflush(stderr);
+            set_exit_status(W_EXITCODE(1, 0));
+            return;
+        }
+        job = &jobs[running.tail];
+    } else if ((job = find_job_arg(argv[1], "fg")) == NULL) {
+        set_exit_status(W_EXITCODE(127, 0));
+        return;
+    }
+    printf("%s\n", job->command);
+    fflush(stdout);
+
+    // stages that finished while the job was in the background are reported as usual; the job's records (the stages
+    // that are still running, and the ones on the finished list) are then all collected before waiting, since the
+    // handler moves them from one list to the other as they finish
+    report_child_events();
+    size_t number = job->number;
+    pid_t last_pid = job->last_pid;
+    size_t count = 0;
+    struct job_list *lists[] = { &running, &finished };
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        for (int record = lists[i]->head; record != NO_JOB; record = jobs[record].next) {
+            count += jobs[record].number == number;
+        }
+    }
+    struct job **stages = malloc(count * sizeof(struct job*));
+    if (stages == NULL) {
+        report_memory_error();
+        set_exit_status(W_EXITCODE(1, 0));
+        return;
+    }
+    count = 0;
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        for (int record = lists[i]->head; record != NO_JOB; record = jobs[record].next) {
+            if (jobs[record].number == number) {
+                jobs[record].foreground = true;
+                stages[count++] = &jobs[record];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        wait_until_done(stages[i]);
+    }
+
+    struct job *last = find_job(last_pid);
+    int wait_status = last != NULL ? last->wait_status : job->wait_status;
+    struct command_usage usage = {0};
+    for (size_t i = 0; i < count; i++) {
+        add_command_usage(&usage, &stages[i]->usage);
+        remove_job(stages[i]);
+    }
+    free(stages);
+
+    record_command_usage(&usage);
+    record_foreground_status(wait_status);
+}
@@ -0,0 +1,28 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of jobs.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_JOBS_H
+#define SMALLSH_JOBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "parsers.h"
+
+size_t get_next_job_number();
+void add_job(struct command *command, pid_t *pids, size_t count);
+void mark_job_done(pid_t pid, int wait_status, const struct rusage *child_usage, struct timespec reaped_at);
+void signal_jobs(int signal_number);
+bool is_foreground_job(pid_t pid);
+void release_job_timeout(pid_t pid);
+bool is_job_group_running(pid_t pgid, const pid_t *pids, size_t count);
+void builtin_jobs(char** argv);
+void builtin_wait(char** argv);
+void builtin_fg(char** argv);
+
+#endif //SMALLSH_JOBS_H
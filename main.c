@@ -1,94 +1,241 @@
 /*
  * Author: Donato Quartuccia
  * Description: A small linux shell with support for running executables from the working directory or PATH, i/o
- *              redirection, variable expansion of '$$' into the shell's pid, and management of foreground and
- *              background processes. Works with space-delimited input strings with the following format:
- *                (#|command) [arg1 arg2 ...] [(>|<) file] [(>|<) file] [&]
+ *              redirection, variable expansion of '$$' into the shell's pid (and of '$!' into the pid of the most
+ *              recent background process), and management of foreground and background processes. Works with
+ *              space-delimited input strings with the following format:
+ *                (#|[keyword ...] command) [arg1 arg2 ...] [redirection ...] [| command ...] [&]
+ *              where a keyword is time, limit, pin or timeout (with their options; see below), and a redirection is
+ *              [n]< file, [n]> file, [n]>> file, [n]>&m or &> file (stdout and stderr). $NAME expands to the value of
+ *              an environment variable, and $(command) to the output of the command (less any trailing newlines).
+ *              Lines can be grouped into if/elif/else/fi, while/done and for NAME in .../done blocks (with break and
+ *              continue), which are compiled once and then run (see script.c).
+ *
+ *              Usage: smallsh [script]
+ *                     smallsh -s socket [-o]
+ *                If a script is passed, or if stdin is not a terminal, the shell runs in batch mode: no prompt is
+ *                printed, and the shell exits once it reaches the end of its input. With -s, the shell runs as a server
+ *                that runs the command lines of every client connecting to the socket in a session of its own (see
+ *                server.c).
  *
  *              The following built-in commands and signals are supported:
  *                * cd      changes the directory (to the shell's location by default)
- *                * status  prints the exit status of the most recent foreground process
- *                * exit    terminates any child processes and exits the shell
+ *                * status  prints the exit status of the most recent foreground process (with -v, also the wall
+ *                          time, CPU time & max RSS it used)
+ *                * stats   prints how long the shell's own work has taken, by phase: reading, expanding & parsing
+ *                          lines, launching & running processes, and handling SIGCHLD (with -v, also histograms;
+ *                          with -r, resets them)
+ *                * hash    prints (or with -r, empties) the cache of command paths resolved from PATH
+ *                * fds     prints the descriptors the shell has open (with -v, what each of them refers to)
+ *                * parallel runs a list of jobs, at most N at a time (see parallel.c)
+ *                * jobs    lists the background processes that are running or have finished since the last check
+ *                * wait    waits for the given background processes (by pid), or for all of them
+ *                * fg      waits for a background job (the most recent one by default) as if it were in the foreground
+ *                * exit    terminates any background jobs (each its own process group) and exits the shell
+ *                * echo, true, false, test ([), pwd, export & printf run without starting a process (see builtins.c)
+ *                * time    (as a prefix) prints the resources used by a foreground command once it's done
+ *                * limit   (as a prefix, with -c cpus and/or -m size) runs a command in a cgroup with those limits
+ *                * pin     (as a prefix, with cpus, -n nodes or -r) runs a command on those CPUs or NUMA nodes
+ *                * timeout (as a prefix, with a duration like 30s) sends a command SIGTERM once it's run that long,
+ *                          and SIGKILL if it's still running TIMEOUT_KILL_DELAY_MS later (SMALLSH_TIMEOUT sets a
+ *                          default for every command; see timeouts.c)
  *                * ^C      immediately terminates any foreground processes being run by the shell
  *                * ^Z      toggles foreground only mode
  *
- *              Last Modified: 2/8/2022
+ *              Background jobs write to /dev/null unless redirected, or with SMALLSH_JOB_OUTPUT set, to the shell's
+ *              stdout a line at a time, with the job number in front of each line (see job_output.c).
+ *
+ *              Last Modified: 10/14/2026
  */
 
+#define _GNU_SOURCE  // ppoll
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
 #include "config.h"
-#include "parsers.h"
-#include "commands.h"
-#include "signal_handlers.h"
+#include "smallsh.h"
+#include "builtins.h"
+#include "server.h"
+#include "script.h"
+#include "reader.h"
+#include "timeouts.h"
+#include "error_handlers.h"
 
 
 /**
- * Set signal handlers and create the process in a new session (if it's not already the session leader)
+ * Initialize the library (signal handlers, expansions and tracing), and create the process in a new session (if it's
+ * not already the session leader)
  */
 void setup() {
-    set_initial_signal_handlers();
+    init_smallsh();
     setsid();
 }
 
+/**
+ * Waits for input to become available on input_fd. SIGCHLD is only unblocked while waiting, so background processes
+ * that terminate in the meantime are reaped the moment they do (by the SIGCHLD handler) and reported right away,
+ * after which the prompt is printed again; likewise, background jobs whose deadline passes are signalled right away
+ * (see expire_timeouts()). Assumes input_fd is a terminal, which delivers input one line at a time.
+ *
+ * @param input_fd the file descriptor to wait on
+ */
+void wait_for_input(int input_fd) {
+    sigset_t wait_mask;
+    sigprocmask(SIG_BLOCK, NULL, &wait_mask);
+    sigdelset(&wait_mask, SIGCHLD);
+
+    struct pollfd poll_fds[3] = {
+        { .fd = input_fd, .events = POLLIN },
+        { .fd = get_child_event_fd(), .events = POLLIN },
+        { .fd = -1, .events = POLLIN }
+    };
+
+    while (true) {
+        poll_fds[2].fd = get_timeout_fd();  // -1 (ignored by ppoll) until a command has had a deadline
+        int ready = ppoll(poll_fds, 3, NULL, &wait_mask);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;  // a signal was handled; the child event pipe (if written to) is picked up on the next poll
+            }
+            return;        // let the read report the problem
+        }
+        if ((poll_fds[1].revents & POLLIN) && clear_child_events() && report_child_events() > 0) {
+            printf(": ");
+            fflush(stdout);
+        }
+        if (poll_fds[2].revents & POLLIN) {
+            expire_timeouts();
+        }
+        if (poll_fds[0].revents != 0) {
+            return;
+        }
+    }
+}
+
 /**
  * Handles shell control flow.
+ *
+ * @param argc the number of command line arguments
+ * @param argv the command line arguments; argv[1], if present, is the path to a script to be run in batch mode, or
+ *             -s followed by the path of the socket to serve sessions on (and optionally -o)
  */
-int main() {
+int main(int argc, char* argv[]) {
+    struct timespec startup_start;
+    clock_gettime(CLOCK_MONOTONIC, &startup_start);
+
+    // in server mode, the input is a client connection (see server.c), which is only known once the shell is set up
+    char *socket_path = NULL;
+    bool stream_output = false;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        socket_path = argv[2];
+        stream_output = argc > 3 && strcmp(argv[3], "-o") == 0;
+    }
+
+    // open the script (if one was passed); the descriptor is close-on-exec so that children don't inherit it
+    int input_fd = STDIN_FILENO;
+    if (argc > 1 && socket_path == NULL) {
+        input_fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (input_fd == -1) {
+            handle_file_error(argv[1], true);
+            return 1;
+        }
+    }
+    // only prompt (and flush the prompt) when a user is actually typing commands
+    bool interactive = input_fd == STDIN_FILENO && isatty(STDIN_FILENO);
+
     setup();
 
-    //
-    char input_buffer[MAX_INPUT_CHARS_SIZE];
+    struct arena *line_arena = create_arena(LINE_ARENA_SIZE);  // backs everything parsed from one line
+    if (line_arena == NULL) {
+        handle_memory_error();
+    }
     bool exit_triggered = false;
     sigset_t sigchld_set;
     sigemptyset(&sigchld_set);
+    sigaddset(&sigchld_set, SIGCHLD);
 
+    // keep SIGCHLD blocked while commands are parsed and run; it's only unblocked between commands and (in interactive
+    // mode) while waiting for input, so the handler never competes with the foreground waitpid
+    sigprocmask(SIG_BLOCK, &sigchld_set, NULL);
 
-    sigaddset(&sigchld_set, SIGCHLD);
+    record_phase(PHASE_STARTUP, startup_start);  // before a server waits for clients (its sessions inherit this)
+
+    // the server only returns here in a session, which runs the client's command lines as if they were a script
+    int session_fd = -1;
+    if (socket_path != NULL) {
+        session_fd = accept_sessions(socket_path, stream_output);
+        if (session_fd == -1) {
+            return 1;
+        }
+        input_fd = session_fd;
+        interactive = false;
+    }
+
+    // lines are read straight out of a mapped script, or out of large blocks read from anything else (see reader.c)
+    struct line_reader *input = create_line_reader(input_fd);
+    if (input == NULL) {
+        handle_memory_error();
+    }
 
     while (!exit_triggered) {
-        // block sigchld until we
+        reset_arena(line_arena);  // the previous command is done with, so release its memory
+
+        // clean up zombie processes; unblocking SIGCHLD delivers any pending signal before sigprocmask returns, so the
+        // handler reaps (and queues) every child that has already terminated, and they're all reported in one batch
+        sigprocmask(SIG_UNBLOCK, &sigchld_set, NULL);
         sigprocmask(SIG_BLOCK, &sigchld_set, NULL);
+        report_child_events();
+        expire_timeouts();  // in batch mode, this (and waiting for commands) is where background deadlines are served
 
         // prompt for input and parse; if the input is a comment or blank line, the result of the parse will be NULL
-        printf(": ");
-        fflush(stdout);
-        if (fgets(input_buffer, MAX_INPUT_CHARS_SIZE, stdin) == NULL) {
-            clearerr(stdin);
+        if (interactive) {
+            clear_child_events();  // anything reaped so far was reported before this prompt
+            printf(": ");
+            fflush(stdout);
+            if (!has_buffered_line(input)) {
+                wait_for_input(input_fd);
+            }
+        }
+        char *line;
+        struct timespec read_start;
+        clock_gettime(CLOCK_MONOTONIC, &read_start);
+        ssize_t input_len = read_line(input, &line);
+        record_phase(PHASE_READ, read_start);
+        if (input_len == -1) {
+            // in batch mode, the end of the input ends the session; otherwise keep prompting; either way, there's
+            // nothing to parse
+            exit_triggered = !interactive;
+            continue;
         }
-        struct command *parsed_command = parse_command(input_buffer);
-
-        if (parsed_command != NULL) {
-            // check whether to exit
-            if (strcmp(parsed_command->argv[0], "exit") == 0) {
-                exit_triggered = true;
-            // check whether to call a built-in
-            } else if (strcmp(parsed_command->argv[0], "cd") == 0) {
-                builtin_cd(parsed_command->argv);
-            } else if (strcmp(parsed_command->argv[0], "status") == 0) {
-                builtin_status();
-            // otherwise check whether we should run the command in the foreground or background
-            } else {
-                run_command(
-                  parsed_command->argv,
-                  parsed_command->i_stream,
-                  parsed_command->o_stream,
-                  parsed_command->background && get_foreground_flag() != 1
-                );
+        // a line that opens a block (if, while or for) brings the rest of the block with it, which is compiled and run
+        // as a whole (see script.c); anything else is parsed and run on its own
+        if (is_block_start(line, input_len)) {
+            exit_triggered = run_block(line, input_len, input, interactive, line_arena);
+        } else {
+            struct command *parsed_command;
+            if (parse_cached_command(line, input_len, line_arena, &parsed_command) == -1) {
+                handle_memory_error();
+            }
+            if (parsed_command != NULL) {
+                exit_triggered = run_parsed_command(parsed_command) == COMMAND_EXIT;
             }
-
-            delete_command_struct(parsed_command);
         }
 
-        // clean up zombie processes and wait a few milliseconds so that any immediately-terminating processes
-        // output a message right away (e.g. for something like "sleep not_an_int &"; 5ms should be enough
-        sigprocmask(SIG_UNBLOCK, &sigchld_set, NULL);
-        usleep(5000);
+        // server clients get a reply to every line they send, blank lines and comments included (and to every block,
+        // once it has run)
+        if (session_fd != -1) {
+            report_session_status(session_fd);
+        }
     }
 
+    delete_line_reader(input);
     builtin_exit();
     return 0;
 }
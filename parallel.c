@@ -0,0 +1,405 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the parallel built-in, which runs a list of jobs with bounded concurrency:
+ *                parallel [-j jobs] [-n] [command [args ...]] ::: arg1 [arg2 ...]
+ *                parallel [-j jobs] [-n] [command [args ...]] :::: file
+ *
+ *              With ":::", every arg is appended to the command to make one job; with "::::", every line of the
+ *              file is. Without a command, each arg (or line) is a command line in its own right, so lines read
+ *              from a file may use pipes and redirection. At most `jobs` jobs (one per CPU by default) run at a
+ *              time; the next one starts as soon as any of them exits. With -n, the job slots are spread over the
+ *              NUMA nodes round-robin, and each job is pinned to its slot's node (its CPUs and memory; see
+ *              affinity.c).
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // W_EXITCODE, wait4
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "config.h"
+#include "arena.h"
+#include "parsers.h"
+#include "commands.h"
+#include "signal_handlers.h"
+#include "error_handlers.h"
+#include "jobs.h"
+#include "trace.h"
+#include "affinity.h"
+#include "timeouts.h"
+#include "parallel.h"
+
+
+/**
+ * Where the jobs come from.
+ *
+ * @property command: the args every job starts with (NULL-terminated; may be empty)
+ * @property command_len: the number of args in command
+ * @property args: the remaining ":::" args (NULL-terminated), or NULL if jobs are read from file
+ * @property file: the "::::" file, or NULL if jobs come from args
+ * @property line: the buffer for the line most recently read from file
+ * @property line_capacity: the size of line
+ */
+struct job_source {
+    char **command;
+    size_t command_len;
+    char **args;
+    FILE *file;
+    char *line;
+    size_t line_capacity;
+};
+
+/**
+ * A job that is currently running.
+ *
+ * @property number: the job's position in the list of jobs (starting at 1)
+ * @property pids: the pids of the job's stages that are still running (0 once reaped)
+ * @property stage_count: the number of entries in pids
+ * @property remaining: the number of stages that are still running; 0 => the slot is free
+ * @property last_pid: the pid of the job's last stage, or -1 if it couldn't be started
+ * @property wait_status: the status of the job's last stage
+ * @property started_at: when the job was started (CLOCK_MONOTONIC)
+ */
+struct job_slot {
+    size_t number;
+    pid_t *pids;
+    size_t stage_count;
+    size_t remaining;
+    pid_t last_pid;
+    int wait_status;
+    struct timespec started_at;
+};
+
+
+/** ------------------------------------------------- job sources ------------------------------------------------- */
+
+/**
+ * Builds a single-stage command from the common args plus one more arg.
+ *
+ * @param source the job source
+ * @param arg the arg to append
+ * @param arena the arena that owns the command
+ * @return a pointer to the command
+ */
+struct command *append_job_arg(struct job_source *source, char* arg, struct arena *arena) {
+    struct command *job = arena_alloc(arena, sizeof(struct command));
+    struct stage *stage = arena_alloc(arena, sizeof(struct stage));
+    char **argv = arena_alloc(arena, (source->command_len + 2) * sizeof(char*));
+    if (job == NULL || stage == NULL || argv == NULL) {
+        handle_memory_error();
+    }
+    memcpy(argv, source->command, source->command_len * sizeof(char*));
+    argv[source->command_len] = arg;
+    argv[source->command_len + 1] = NULL;
+
+    stage->argv = argv;
+    stage->redirects = NULL;
+    stage->redirect_count = 0;
+    *job = (struct command) { .stages = stage, .stage_count = 1 };
+    return job;
+}
+
+/**
+ * Parses a job from a command line, as the shell would.
+ *
+ * @param line the command line (may be modified)
+ * @param line_len the length of the line
+ * @param arena the arena that owns the job
+ * @return a pointer to the job, or NULL if the line is blank or a comment
+ */
+struct command *parse_job(char* line, size_t line_len, struct arena *arena) {
+    struct command *job;
+    if (parse_command(line, line_len, arena, &job) == -1) {
+        handle_memory_error();
+    }
+    return job;
+}
+
+/**
+ * Produces the next job. Blank lines and comments in a job file are skipped.
+ *
+ * @param source the job source
+ * @param arena the arena that owns the job (valid until the arena is reset)
+ * @return a pointer to the next job, or NULL if there are no jobs left
+ */
+struct command *next_job(struct job_source *source, struct arena *arena) {
+    if (source->args != NULL) {
+        if (*source->args == NULL) {
+            return NULL;
+        }
+        char *arg = *source->args;
+        source->args++;
+        return source->command_len == 0
+            ? parse_job(arg, strlen(arg), arena)
+            : append_job_arg(source, arg, arena);
+    }
+
+    ssize_t line_len;
+    while ((line_len = getline(&source->line, &source->line_capacity, source->file)) != -1) {
+        if (source->command_len == 0) {
+            struct command *job = parse_job(source->line, line_len, arena);
+            if (job != NULL) {
+                return job;
+            }
+        } else {
+            if (line_len > 0 && source->line[line_len - 1] == '\n') {
+                source->line[line_len - 1] = 0;
+            }
+            return append_job_arg(source, source->line, arena);
+        }
+    }
+    return NULL;
+}
+
+
+/** -------------------------------------------------- builtin --------------------------------------------------- */
+
+/**
+ * Prints a usage message to stderr.
+ */
+void print_parallel_usage() {
+    fprintf(stderr, "Usage: parallel [-j jobs] [-n] [command [args ...]] (::: arg1 [arg2 ...] | :::: file)\n");
+    fflush(stderr);
+}
+
+/**
+ * Prints the termination status of a finished job, e.g.:
+ *   Job 3 (PID 1234) is done: exit value 0
+ *
+ * @param slot the job's slot
+ */
+void report_job_status(struct job_slot *slot) {
+    if (slot->last_pid == -1) {
+        printf("Job %zu could not be started\n", slot->number);
+    } else if (WIFSIGNALED(slot->wait_status)) {
+        printf("Job %zu (PID %d) is done: terminated by signal %d\n",
+            slot->number, slot->last_pid, WTERMSIG(slot->wait_status));
+    } else {
+        printf("Job %zu (PID %d) is done: exit value %d\n",
+            slot->number, slot->last_pid, WEXITSTATUS(slot->wait_status));
+    }
+    fflush(stdout);
+}
+
+/**
+ * Starts a job in a free slot.
+ *
+ * @param slot the slot
+ * @param job the job to start
+ * @param number the job's position in the list of jobs
+ */
+void start_job(struct job_slot *slot, struct command *job, size_t number) {
+    free(slot->pids);
+    slot->pids = malloc(job->stage_count * sizeof(pid_t));
+    if (slot->pids == NULL) {
+        handle_memory_error();
+    }
+    bool last_started;
+    slot->number = number;
+    clock_gettime(CLOCK_MONOTONIC, &slot->started_at);
+    slot->stage_count = start_command(job, false, -1, -1, slot->pids, &last_started);
+    slot->remaining = slot->stage_count;
+    slot->last_pid = last_started ? slot->pids[slot->stage_count - 1] : -1;
+    slot->wait_status = W_EXITCODE(1, 0);  // overwritten once the last stage is reaped
+}
+
+/**
+ * Runs jobs with at most the requested number of them running at a time, reporting the status of each job as it
+ * finishes. Jobs run in the foreground, so ^C terminates the ones that are running (and no more are started). The
+ * exit status of the built-in is 0 if every job succeeded, or 1 otherwise; the resources used by all of the jobs
+ * together are recorded for status -v.
+ *
+ * @param argv the parsed argv[] array (including the command)
+ */
+void builtin_parallel(char** argv) {
+    long job_limit = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+
+    // parse "-j N" or "-jN"
+    if (argv[i] != NULL && strncmp(argv[i], "-j", 2) == 0) {
+        char *limit_string = argv[i][2] != 0 ? &argv[i][2] : argv[++i];
+        char *limit_end = NULL;
+        job_limit = limit_string == NULL ? 0 : strtol(limit_string, &limit_end, 10);
+        if (job_limit < 1 || *limit_end != 0) {
+            print_parallel_usage();
+            record_foreground_status(W_EXITCODE(1, 0));
+            return;
+        }
+        i++;
+    }
+    // the limit comes from the user, and each slot has memory of its own, so it's capped at the size of the job table
+    if (job_limit < 1) {
+        job_limit = 1;
+    } else if (job_limit > MAX_JOBS) {
+        job_limit = MAX_JOBS;
+    }
+    bool pin_nodes = argv[i] != NULL && strcmp(argv[i], "-n") == 0;
+    if (pin_nodes) {
+        i++;
+        if (get_cpu_node(0) == -1) {
+            fprintf(stderr, "Error. parallel: the NUMA topology can't be read\n");
+            fflush(stderr);
+            record_foreground_status(W_EXITCODE(1, 0));
+            return;
+        }
+    }
+
+    // everything up to the separator is the command; then come the args, or the file
+    struct job_source source = { .command = &argv[i] };
+    while (argv[i] != NULL && strcmp(argv[i], ":::") != 0 && strcmp(argv[i], "::::") != 0) {
+        i++;
+    }
+    source.command_len = &argv[i] - source.command;
+    if (argv[i] == NULL || (strcmp(argv[i], "::::") == 0 && (argv[i + 1] == NULL || argv[i + 2] != NULL))) {
+        print_parallel_usage();
+        record_foreground_status(W_EXITCODE(1, 0));
+        return;
+    }
+    if (strcmp(argv[i], ":::") == 0) {
+        source.args = &argv[i + 1];
+
+        // there's no use for more slots than there are jobs
+        long arg_count = 0;
+        while (source.args[arg_count] != NULL) {
+            arg_count++;
+        }
+        if (job_limit > arg_count) {
+            job_limit = arg_count > 0 ? arg_count : 1;
+        }
+    } else {
+        source.file = fopen(argv[i + 1], "re");
+        if (source.file == NULL) {
+            handle_file_error(argv[i + 1], true);
+            record_foreground_status(W_EXITCODE(1, 0));
+            return;
+        }
+    }
+
+    struct arena *job_arena = create_arena(LINE_ARENA_SIZE);
+    struct job_slot *slots = calloc(job_limit, sizeof(struct job_slot));
+    if (job_arena == NULL || slots == NULL) {
+        handle_memory_error();
+    }
+
+    struct command_usage usage = {0};  // of every job together
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    size_t jobs_started = 0;
+    size_t failed = 0;
+    long running = 0;
+    bool interrupted = false;
+    int interrupted_status = 0;
+    bool jobs_left = true;
+
+    while (true) {
+        // fill every free slot; a job with no stages left to wait for (e.g. one that couldn't be started) finishes
+        // right away
+        for (long slot = 0; slot < job_limit && jobs_left && !interrupted; slot++) {
+            if (slots[slot].remaining != 0) {
+                continue;
+            }
+            reset_arena(job_arena);
+            struct command *job = next_job(&source, job_arena);
+            if (job == NULL) {
+                jobs_left = false;
+                break;
+            }
+            if (pin_nodes) {
+                char *node = arena_alloc(job_arena, 16);
+                if (node == NULL) {
+                    handle_memory_error();
+                }
+                snprintf(node, 16, "%d", get_cpu_node(slot));
+                job->pinning = (struct command_pinning) { .list = node, .nodes = true };
+            }
+            jobs_started++;
+            start_job(&slots[slot], job, jobs_started);
+            if (slots[slot].remaining == 0) {
+                report_job_status(&slots[slot]);
+                failed++;
+                slot--;  // try the slot again
+            } else {
+                running++;
+            }
+        }
+        if (running == 0) {
+            break;
+        }
+
+        // wait for any child (serving the deadlines of jobs with a timeout meanwhile); SIGCHLD is blocked while
+        // built-ins run, so background processes that finish meanwhile are reaped (and reported) here as well
+        int wait_status;
+        struct rusage child_usage;
+        pid_t pid = wait_for_child(-1, &wait_status, &child_usage);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        cancel_timeout(pid);
+
+        struct job_slot *owner = NULL;
+        for (long slot = 0; slot < job_limit && owner == NULL; slot++) {
+            for (size_t stage = 0; stage < slots[slot].stage_count && slots[slot].remaining != 0; stage++) {
+                if (slots[slot].pids[stage] == pid) {
+                    owner = &slots[slot];
+                    owner->pids[stage] = 0;
+                    break;
+                }
+            }
+        }
+        struct timespec reaped_at;
+        clock_gettime(CLOCK_MONOTONIC, &reaped_at);
+        trace_exit(pid, wait_status, &child_usage, reaped_at, owner == NULL);
+        if (owner == NULL) {
+            mark_job_done(pid, wait_status, &child_usage, reaped_at);
+            release_job_timeout(pid);
+            report_background_status(pid, wait_status);
+            continue;
+        }
+
+        add_child_usage(&usage, &child_usage);
+        record_phase(PHASE_RUN, owner->started_at);
+        if (pid == owner->last_pid) {
+            owner->wait_status = wait_status;
+        }
+        owner->remaining--;
+        if (owner->remaining == 0) {
+            running--;
+            report_job_status(owner);
+            if (!WIFEXITED(owner->wait_status) || WEXITSTATUS(owner->wait_status) != 0) {
+                failed++;
+            }
+            if (WIFSIGNALED(owner->wait_status) && WTERMSIG(owner->wait_status) == SIGINT) {
+                interrupted = true;
+                interrupted_status = owner->wait_status;
+            }
+        }
+    }
+
+    // a ^C is reported just like it is for any other foreground process
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usage.wall_time = subtract_timespec(now, started_at);
+    record_command_usage(&usage);
+    record_foreground_status(interrupted ? interrupted_status : W_EXITCODE(failed > 0 ? 1 : 0, 0));
+
+    for (long slot = 0; slot < job_limit; slot++) {
+        free(slots[slot].pids);
+    }
+    free(slots);
+    delete_arena(job_arena);
+    if (source.file != NULL) {
+        fclose(source.file);
+    }
+    free(source.line);
+}
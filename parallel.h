@@ -0,0 +1,12 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of parallel.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_PARALLEL_H
+#define SMALLSH_PARALLEL_H
+
+void builtin_parallel(char** argv);
+
+#endif //SMALLSH_PARALLEL_H
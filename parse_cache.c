@@ -0,0 +1,352 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the parse cache, which remembers the commands parsed from recently seen lines so that lines
+ *              repeated by loops and generated scripts aren't expanded and parsed again. Lines are looked up by a hash
+ *              of their raw text (and then compared in full); the least recently used entry is replaced once the
+ *              cache is full.
+ *
+ *              Only lines whose parse can't change are cached: lines without expansions, or whose only expansion is
+ *              $$ (which is fixed for the life of the shell). Cached commands are deep copies, owned by the cache,
+ *              which are shared between every use of the line and must not be modified.
+ *              Last Modified: 10/14/2026
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "arena.h"
+#include "parsers.h"
+#include "trace.h"
+#include "parse_cache.h"
+
+#define NO_ENTRY -1                 // the end of a list of entries
+#define BUCKET_COUNT (2 * PARSE_CACHE_SIZE)
+
+
+/**
+ * A cached line and the command parsed from it.
+ *
+ * @property hash: the hash of the line
+ * @property line: the raw line (in arena)
+ * @property line_len: the length of the line
+ * @property command: the command parsed from the line (in arena)
+ * @property arena: the memory of the entry, reused whenever the entry is replaced
+ * @property bucket_next: the position + 1 of the next entry in the same bucket; 0 => last
+ * @property prev: the entry that was used more recently; NO_ENTRY => most recently used
+ * @property next: the entry that was used less recently; NO_ENTRY => least recently used
+ */
+struct cache_entry {
+    uint64_t hash;
+    char *line;
+    size_t line_len;
+    struct command *command;
+    struct arena *arena;
+    int bucket_next;
+    int prev;
+    int next;
+};
+
+static struct cache_entry entries[PARSE_CACHE_SIZE];
+static int buckets[BUCKET_COUNT];       // the position + 1 of the first entry in each bucket; 0 => empty
+static int entry_count = 0;             // entries from here on have never been used
+static int most_recent = NO_ENTRY;
+static int least_recent = NO_ENTRY;
+static int spare_entry = NO_ENTRY;      // an entry that's in neither list, because a line couldn't be copied into it
+
+
+/** ---------------------------------------------------- lines ---------------------------------------------------- */
+
+/**
+ * Hashes a line (64-bit FNV-1a).
+ *
+ * @param line the line
+ * @param line_len the length of the line
+ * @return the hash of the line
+ */
+uint64_t hash_line(const char* line, size_t line_len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < line_len; i++) {
+        hash = (hash ^ (unsigned char) line[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Returns true if the parse of the line can't change, i.e. if every '$' in it is part of a "$$".
+ *
+ * @param line the line
+ * @param line_len the length of the line
+ */
+bool has_fixed_parse(const char* line, size_t line_len) {
+    const char *end = line + line_len;
+    for (const char *dollar = memchr(line, '$', line_len); dollar != NULL; ) {
+        if (dollar + 1 == end || dollar[1] != '$') {
+            return false;
+        }
+        dollar += 2;
+        dollar = dollar < end ? memchr(dollar, '$', end - dollar) : NULL;
+    }
+    return true;
+}
+
+/**
+ * Returns true if the parse of the line can be cached, i.e. if it isn't too long and its parse can't change.
+ *
+ * @param line the line
+ * @param line_len the length of the line
+ */
+bool is_cacheable(const char* line, size_t line_len) {
+    return line_len <= PARSE_CACHE_LINE_SIZE && has_fixed_parse(line, line_len);
+}
+
+/**
+ * Copies a string into an arena.
+ *
+ * @param arena the arena
+ * @param string the string, or NULL
+ * @return a pointer to the copy (NULL if string is NULL), or NULL (with *failed set to true) if memory couldn't be
+ *         allocated
+ */
+char *copy_string(struct arena *arena, const char* string, bool *failed) {
+    if (string == NULL) {
+        return NULL;
+    }
+    size_t len = strlen(string);
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy == NULL) {
+        *failed = true;
+        return NULL;
+    }
+    memcpy(copy, string, len + 1);
+    return copy;
+}
+
+/**
+ * Makes a deep copy of a command, i.e. of its stages and everything they point to.
+ *
+ * @param command the command to copy
+ * @param arena the arena that owns the copy
+ * @return a pointer to the copy, or NULL if memory couldn't be allocated
+ */
+struct command *copy_command(const struct command *command, struct arena *arena) {
+    struct command *copy = arena_alloc(arena, sizeof(struct command));
+    struct stage *stages = arena_alloc(arena, command->stage_count * sizeof(struct stage));
+    if (copy == NULL || stages == NULL) {
+        return NULL;
+    }
+    *copy = *command;
+    copy->stages = stages;
+
+    bool failed = false;
+    copy->pinning.list = copy_string(arena, command->pinning.list, &failed);
+    for (size_t i = 0; i < command->stage_count && !failed; i++) {
+        const struct stage *stage = &command->stages[i];
+        size_t argc = 0;
+        while (stage->argv[argc] != NULL) {
+            argc++;
+        }
+        stages[i].argv = arena_alloc(arena, (argc + 1) * sizeof(char*));
+        stages[i].redirect_count = stage->redirect_count;
+        stages[i].redirects = stage->redirect_count == 0 ? NULL
+            : arena_alloc(arena, stage->redirect_count * sizeof(struct redirect));
+        if (stages[i].argv == NULL || (stage->redirect_count != 0 && stages[i].redirects == NULL)) {
+            return NULL;
+        }
+        for (size_t j = 0; j < argc; j++) {
+            stages[i].argv[j] = copy_string(arena, stage->argv[j], &failed);
+        }
+        stages[i].argv[argc] = NULL;
+        for (size_t j = 0; j < stage->redirect_count; j++) {
+            stages[i].redirects[j] = stage->redirects[j];
+            stages[i].redirects[j].file = copy_string(arena, stage->redirects[j].file, &failed);
+        }
+    }
+    return failed ? NULL : copy;
+}
+
+
+/** ---------------------------------------------------- cache ---------------------------------------------------- */
+
+/**
+ * Unlinks an entry from the recently used list.
+ *
+ * @param entry the position of the entry
+ */
+void unlink_entry(int entry) {
+    if (entries[entry].prev != NO_ENTRY) {
+        entries[entries[entry].prev].next = entries[entry].next;
+    } else {
+        most_recent = entries[entry].next;
+    }
+    if (entries[entry].next != NO_ENTRY) {
+        entries[entries[entry].next].prev = entries[entry].prev;
+    } else {
+        least_recent = entries[entry].prev;
+    }
+}
+
+/**
+ * Links an entry into the recently used list as the most recently used one.
+ *
+ * @param entry the position of the entry
+ */
+void link_entry(int entry) {
+    entries[entry].prev = NO_ENTRY;
+    entries[entry].next = most_recent;
+    if (most_recent != NO_ENTRY) {
+        entries[most_recent].prev = entry;
+    } else {
+        least_recent = entry;
+    }
+    most_recent = entry;
+}
+
+/**
+ * Finds the entry for a line.
+ *
+ * @param line the line
+ * @param line_len the length of the line
+ * @param hash the hash of the line
+ * @return the position of the entry, or NO_ENTRY if the line isn't cached
+ */
+int find_entry(const char* line, size_t line_len, uint64_t hash) {
+    for (int link = buckets[hash % BUCKET_COUNT]; link != 0; link = entries[link - 1].bucket_next) {
+        struct cache_entry *entry = &entries[link - 1];
+        if (entry->hash == hash && entry->line_len == line_len && memcmp(entry->line, line, line_len) == 0) {
+            return link - 1;
+        }
+    }
+    return NO_ENTRY;
+}
+
+/**
+ * Removes an entry from its bucket.
+ *
+ * @param entry the position of the entry
+ */
+void remove_from_bucket(int entry) {
+    int *link = &buckets[entries[entry].hash % BUCKET_COUNT];
+    while (*link != entry + 1) {
+        link = &entries[*link - 1].bucket_next;
+    }
+    *link = entries[entry].bucket_next;
+}
+
+/**
+ * Hands out an entry for a new line: the spare one, one that has never been used, or else the least recently used one
+ * (which is removed from the cache). Either way, its arena is empty.
+ *
+ * @return the position of the entry, or NO_ENTRY if its arena couldn't be allocated
+ */
+int reuse_entry() {
+    int entry;
+    if (spare_entry != NO_ENTRY) {
+        entry = spare_entry;
+        spare_entry = NO_ENTRY;
+        reset_arena(entries[entry].arena);
+    } else if (entry_count < PARSE_CACHE_SIZE) {
+        entry = entry_count;
+        entries[entry].arena = create_arena(PARSE_CACHE_ENTRY_SIZE);
+        if (entries[entry].arena == NULL) {
+            return NO_ENTRY;
+        }
+        entry_count++;
+    } else {
+        entry = least_recent;
+        unlink_entry(entry);
+        remove_from_bucket(entry);
+        reset_arena(entries[entry].arena);
+    }
+    return entry;
+}
+
+/**
+ * Adds a line and the command parsed from it to the cache. If memory can't be allocated, the line is simply not
+ * cached.
+ *
+ * @param line the raw line
+ * @param line_len the length of the line
+ * @param hash the hash of the line
+ * @param command the command parsed from the line
+ */
+void add_entry(const char* line, size_t line_len, uint64_t hash, const struct command *command) {
+    int entry = reuse_entry();
+    if (entry == NO_ENTRY) {
+        return;
+    }
+    struct cache_entry *cached = &entries[entry];
+    cached->line = arena_alloc(cached->arena, line_len);
+    cached->command = copy_command(command, cached->arena);
+    if (cached->line == NULL || cached->command == NULL) {
+        spare_entry = entry;  // the first to be handed out again
+        return;
+    }
+    memcpy(cached->line, line, line_len);
+    cached->line_len = line_len;
+    cached->hash = hash;
+    cached->bucket_next = buckets[hash % BUCKET_COUNT];
+    buckets[hash % BUCKET_COUNT] = entry + 1;
+    link_entry(entry);
+}
+
+
+/** ---------------------------------------------------- parsing ---------------------------------------------------- */
+
+/**
+ * Parses a line like parse_command(), except that the command is taken from the cache if the line was seen recently
+ * (and is added to it otherwise, if it's cacheable). A cached command belongs to the cache, must not be modified, and
+ * stays valid until the next call.
+ *
+ * @param input_string pointer to the string to be parsed (followed by at least one writable byte, e.g. its null term)
+ * @param input_len the length of the string
+ * @param arena the arena that owns any command struct that isn't cached
+ * @param result where to store a pointer to the command struct, or NULL if the input is blank or a comment
+ * @return 0 on success, or -1 (with errno set to ENOMEM) if memory couldn't be allocated
+ */
+int parse_cached_command(char* input_string, size_t input_len, struct arena *arena, struct command **result) {
+    if (!is_cacheable(input_string, input_len)) {
+        return parse_command(input_string, input_len, arena, result);
+    }
+
+    uint64_t hash = hash_line(input_string, input_len);
+    int entry = find_entry(input_string, input_len, hash);
+    if (entry != NO_ENTRY) {
+        unlink_entry(entry);
+        link_entry(entry);
+        *result = entries[entry].command;
+        trace_command(*result);
+        return 0;
+    }
+
+    // lines without a '$' are split in place, so keep the raw line for the cache to compare against later
+    char *line = arena_alloc(arena, input_len);
+    if (line == NULL) {
+        return parse_command(input_string, input_len, arena, result);
+    }
+    memcpy(line, input_string, input_len);
+    if (parse_command(input_string, input_len, arena, result) == -1) {
+        return -1;
+    }
+    if (*result != NULL) {
+        add_entry(line, input_len, hash, *result);
+    }
+    return 0;
+}
+
+/**
+ * Empties the cache, e.g. because the value of $$ has changed.
+ */
+void clear_parse_cache() {
+    while (most_recent != NO_ENTRY) {
+        int entry = most_recent;
+        unlink_entry(entry);
+        remove_from_bucket(entry);
+        delete_arena(entries[entry].arena);
+    }
+    if (spare_entry != NO_ENTRY) {
+        delete_arena(entries[spare_entry].arena);
+        spare_entry = NO_ENTRY;
+    }
+    entry_count = 0;
+}
@@ -0,0 +1,19 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of parse_cache.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_PARSE_CACHE_H
+#define SMALLSH_PARSE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+#include "parsers.h"
+
+bool has_fixed_parse(const char* line, size_t line_len);
+int parse_cached_command(char* input_string, size_t input_len, struct arena *arena, struct command **result);
+void clear_parse_cache();
+
+#endif //SMALLSH_PARSE_CACHE_H
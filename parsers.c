@@ -1,302 +1,1076 @@
 /*
  * Author: Donato Quartuccia
  * Description: Contains functions that parse user input into a command struct.
- *              Last Modified: 2/8/2022
+ *              Last Modified: 10/14/2026
  */
 
+#include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 #include "config.h"
-#include "error_handlers.h"
+#include "arena.h"
 #include "parsers.h"
+#include "commands.h"
+#include "affinity.h"
+#include "timeouts.h"
+#include "trace.h"
 
 
 /** ------------------------------------------ command struct definitions ----------------------------------------- */
 
 /**
- * Creates a command struct with the following initial values:
- *  command: NULL;
- *  args: NULL;
+ * Creates a command struct in the passed arena with the following initial values:
+ *  stages: NULL;
+ *  stage_count: 0;
  *  background: false;
- *  i_stream: NULL;
- *  o_stream: NULL;
+ *  timed: false;
+ *  limits: none;
+ *  pinning: none;
+ *  timeout_ms: 0;
  *
+ * @param arena the arena that owns the struct
  * @return a pointer to the command struct on success, or NULL on failure
  */
-struct command *create_command_struct() {
-    struct command *created_command = malloc(sizeof(struct command));
+struct command *create_command_struct(struct arena *arena) {
+    struct command *created_command = arena_alloc(arena, sizeof(struct command));
     if (created_command == NULL) {
         return NULL;
     }
-    created_command->argv = NULL;
+    created_command->stages = NULL;
+    created_command->stage_count = 0;
     created_command->background = false;
-    created_command->i_stream = NULL;
-    created_command->o_stream = NULL;
+    created_command->timed = false;
+    created_command->limits = (struct command_limits) {0};
+    created_command->pinning = (struct command_pinning) {0};
+    created_command->timeout_ms = 0;
     return created_command;
 }
 
-void delete_command_struct(struct command *command_struct) {
-    // free all the arg strings in argv[]
-    int i = 0;
-    while (command_struct->argv[i] != NULL) {
-        free(command_struct->argv[i]);
-        i++;
-    }
-    // free everything else
-    free(command_struct->argv);
-    free(command_struct->i_stream);
-    free(command_struct->o_stream);
-    free(command_struct);
-}
-
 /**
  * Prints a command struct to stdout. For debugging only.
  *
  * @param parsed_command the command struct to print
  */
 void print_command_struct(struct command *parsed_command) {
-    int i = 0;
-    printf("| ");
-    fflush(stdout);
-    while (parsed_command->argv[i] != NULL) {
-        printf("%s ", parsed_command->argv[i]);
-        i++;
+    for (size_t stage = 0; stage < parsed_command->stage_count; stage++) {
+        struct stage *current = &parsed_command->stages[stage];
+        int i = 0;
+        printf("| ");
+        while (current->argv[i] != NULL) {
+            printf("%s ", current->argv[i]);
+            i++;
+        }
+        for (size_t j = 0; j < current->redirect_count; j++) {
+            struct redirect *redirect = &current->redirects[j];
+            if (redirect->type == REDIRECT_DUPLICATE) {
+                printf("%d>&%d ", redirect->fd, redirect->source_fd);
+            } else {
+                printf("%d%s %s ", redirect->fd, redirect->type == REDIRECT_INPUT ? "<"
+                    : redirect->type == REDIRECT_APPEND ? ">>" : ">", redirect->file);
+            }
+        }
     }
+    const struct command_pinning *pinning = &parsed_command->pinning;
+    printf("BG: %d, TIME: %d, CPU: %ld, MEM: %lld, PIN: %s%s, TIMEOUT: %ld\n", parsed_command->background,
+        parsed_command->timed, parsed_command->limits.cpu_quota, parsed_command->limits.memory_max,
+        pinning->nodes ? "nodes " : "", pinning->list != NULL ? pinning->list : "-", parsed_command->timeout_ms);
     fflush(stdout);
-    printf("BG: %d, ", parsed_command->background);
-    fflush(stdout);
-    printf("I: %s, O: %s\n", parsed_command->i_stream, parsed_command->o_stream);
-    fflush(stdout);
+}
+
+
+/** ------------------------------------------------- expansions -------------------------------------------------- */
+
+/**
+ * The value a special variable ($<name>) expands to.
+ *
+ * @property value: the expanded value (not null-terminated)
+ * @property len: the length of value; zero if the name isn't a variable
+ */
+struct expansion {
+    char value[12];  // fits any int
+    size_t len;
+};
+
+extern char **environ;
+
+/**
+ * The kinds of expansion that start with a '$'.
+ */
+enum expansion_type {
+    EXPANSION_NONE,          // an ordinary '$'
+    EXPANSION_SPECIAL,       // a special variable, e.g. $$
+    EXPANSION_SUBSTITUTION,  // a command substitution, $(command)
+    EXPANSION_VARIABLE       // a named variable, $NAME
+};
+
+/**
+ * The output of a command substitution.
+ *
+ * @property value: the output, less any trailing newlines (not null-terminated)
+ * @property len: the length of value
+ */
+struct substitution {
+    const char *value;
+    size_t len;
+};
+
+static struct expansion expansions[128];  // indexed by the variable's name, e.g. expansions['$'] holds the pid
+
+/**
+ * Sets the value a special variable expands to.
+ *
+ * @param name the name of the variable, i.e. the char that follows the '$'
+ * @param value the value of the variable
+ */
+void set_expansion(char name, int value) {
+    struct expansion *expansion = &expansions[(unsigned char) name % 128];
+    expansion->len = snprintf(expansion->value, sizeof(expansion->value), "%d", value);
+}
 
+/**
+ * Looks up a special variable in the expansion table.
+ *
+ * @param name the name of the variable, i.e. the char that follows the '$'
+ * @return a pointer to the variable's expansion, or NULL if the name isn't a variable
+ */
+const struct expansion *find_expansion(char name) {
+    unsigned char index = (unsigned char) name;
+    if (index >= sizeof(expansions) / sizeof(expansions[0]) || expansions[index].len == 0) {
+        return NULL;
+    }
+    return &expansions[index];
 }
 
+/**
+ * Builds the expansion table. Must be called once at startup, before any input is parsed. Values are only changed
+ * (with set_expansion()) between lines, so nothing has to be recomputed per line.
+ */
+void init_expansions() {
+    set_expansion('$', getpid());
+}
 
-/** ----------------------------------------------- command parser ------------------------------------------------ */
+/**
+ * Returns the length of the variable name at the start of a string, i.e. of the longest run of letters, digits and
+ * underscores that doesn't start with a digit.
+ *
+ * @param string the string (not necessarily null-terminated)
+ * @param len the length of the string
+ * @return the length of the name; 0 if the string doesn't start with one
+ */
+size_t read_variable_name(const char* string, size_t len) {
+    size_t i = 0;
+    while (i < len && (string[i] == '_' || (string[i] >= 'a' && string[i] <= 'z')
+            || (string[i] >= 'A' && string[i] <= 'Z') || (i > 0 && string[i] >= '0' && string[i] <= '9'))) {
+        i++;
+    }
+    return i;
+}
 
 /**
- * Trims whitespace from the end of the input string and returns the new length of the string.
+ * Looks up a named variable ($NAME), i.e. an environment variable.
  *
- * @param input_string pointer to the string to be trimmed
+ * @param name the name of the variable (not null-terminated)
+ * @param name_len the length of the name
+ * @return a pointer to the value of the variable, or NULL if it isn't set
+ */
+const char *find_variable(const char* name, size_t name_len) {
+    for (char **variable = environ; *variable != NULL; variable++) {
+        if (strncmp(*variable, name, name_len) == 0 && (*variable)[name_len] == '=') {
+            return *variable + name_len + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds the ')' that closes a command substitution, counting any parentheses nested in the command (e.g. another
+ * substitution).
+ *
+ * @param string the string
+ * @param i the index of the '$' of the "$("
  * @param len the length of the string
- * @return the new length of the string
+ * @return the index of the ')', or len if the substitution is never closed
  */
-int truncate_right(char* input_string, int len) {
-    while (len > 0 && (input_string[len - 1] == ' ' || input_string[len - 1] == '\n')) {
-        input_string[len - 1] = 0;  // truncate
-        len--;
+size_t find_substitution_end(const char* string, size_t i, size_t len) {
+    size_t depth = 0;
+    for (size_t j = i + 1; j < len; j++) {
+        if (string[j] == '(') {
+            depth++;
+        } else if (string[j] == ')' && --depth == 0) {
+            return j;
+        }
     }
     return len;
 }
 
+/**
+ * Reads the expansion that starts at a '$'. Special variables take precedence, then command substitutions, then
+ * named variables; a '$' that starts none of them (including a "$(" that's never closed) is an ordinary char.
+ *
+ * @param string the string
+ * @param i the index of the '$'
+ * @param len the length of the string
+ * @param type where to store the kind of expansion
+ * @return the length of the expansion's text, '$' included
+ */
+size_t read_expansion(const char* string, size_t i, size_t len, enum expansion_type *type) {
+    if (i + 1 < len && find_expansion(string[i + 1]) != NULL) {
+        *type = EXPANSION_SPECIAL;
+        return 2;
+    }
+    if (i + 1 < len && string[i + 1] == '(') {
+        size_t end = find_substitution_end(string, i, len);
+        if (end < len) {
+            *type = EXPANSION_SUBSTITUTION;
+            return end - i + 1;
+        }
+    }
+    size_t name_len = read_variable_name(&string[i + 1], len - i - 1);
+    *type = name_len > 0 ? EXPANSION_VARIABLE : EXPANSION_NONE;
+    return 1 + name_len;
+}
+
+/**
+ * Gets the value of the expansion that starts at a '$'.
+ *
+ * @param string the string
+ * @param i the index of the '$'
+ * @param text_len the length of the expansion's text (see read_expansion())
+ * @param type the kind of expansion
+ * @param substitution the output of the command substitution, if it is one (NULL if it wasn't run)
+ * @param value_len where to store the length of the value
+ * @return a pointer to the value (not null-terminated)
+ */
+const char *get_expansion_value(const char* string, size_t i, size_t text_len, enum expansion_type type,
+                                const struct substitution *substitution, size_t *value_len) {
+    const char *value = NULL;
+    switch (type) {
+        case EXPANSION_SPECIAL: {
+            const struct expansion *expansion = find_expansion(string[i + 1]);
+            *value_len = expansion->len;
+            return expansion->value;
+        }
+        case EXPANSION_SUBSTITUTION:
+            *value_len = substitution != NULL ? substitution->len : 0;
+            return substitution != NULL ? substitution->value : "";
+        case EXPANSION_VARIABLE:
+            value = find_variable(&string[i + 1], text_len - 1);
+            *value_len = value != NULL ? strlen(value) : 0;
+            return value != NULL ? value : "";
+        default:
+            *value_len = 1;
+            return "$";
+    }
+}
 
 /**
- * Parses the passed string into an argv[] array of char pointers. Assumes the args are space-delimited.
+ * Computes the length of a string once everything in it has been expanded, using the same rules as expand().
  *
- * @param command_struct the struct whose argv property is to be populated
- * @param argv_string a space-delimited string of args
+ * @param input_string pointer to the string
+ * @param input_len the length of the string
+ * @param substitutions the outputs of the string's command substitutions, in order (NULL if they weren't run)
+ * @return the length of the expanded string
  */
-void parse_args(struct command *command_struct, char* argv_string) {
-    // allocate space for the argv[] array, which needs to be terminated by a null pointer for use with exec()
-    command_struct->argv = calloc(MAX_INPUT_CHARS_SIZE, sizeof(char*));
-    if (command_struct->argv == NULL) {
-        handle_memory_error();
-    }
-
-    char *DELIMITER = " ";
-    char *arg_token;
-    char *save_ptr;
-
-    // get the first token (argv[0] = command) and continue parsing until there are no more args
-    int i = 0;
-    arg_token = strtok_r(argv_string, DELIMITER, &save_ptr);
-    do {
-        // copy the arg
-        command_struct->argv[i] = calloc(strlen(arg_token) + 1, sizeof(char));
-        if (command_struct->argv[i] == NULL) {
-            handle_memory_error();
+size_t measure_expansion(const char* input_string, size_t input_len, const struct substitution *substitutions) {
+    size_t len = input_len;
+    const char *dollar = memchr(input_string, '$', input_len);
+    while (dollar != NULL) {
+        size_t i = dollar - input_string;
+        enum expansion_type type;
+        size_t text_len = read_expansion(input_string, i, input_len, &type);
+        size_t value_len;
+        get_expansion_value(input_string, i, text_len, type, substitutions, &value_len);
+        if (type == EXPANSION_SUBSTITUTION && substitutions != NULL) {
+            substitutions++;
         }
-        strcpy(command_struct->argv[i], arg_token);
+        len = len - text_len + value_len;
+        i += text_len;
+        dollar = i < input_len ? memchr(&input_string[i], '$', input_len - i) : NULL;
+    }
+    return len;
+}
 
-        // parse the next arg
-        arg_token = strtok_r(NULL, DELIMITER, &save_ptr);
-        i++;
-    } while (arg_token != NULL && i < MAX_ARGV_SIZE);
+/**
+ * Runs the command substitutions ($(command)) of a line, in order, and collects their output. Each command is parsed
+ * (and expanded, so substitutions can be nested) like a line of its own, then run in the foreground with
+ * capture_command(); its output, less any trailing newlines, is what the substitution expands to. Nothing is run for
+ * a comment.
+ *
+ * @param input_string pointer to the line
+ * @param input_len the length of the line
+ * @param arena the arena that owns the outputs (and the commands)
+ * @param result where to store a pointer to the outputs, or NULL if there are none
+ * @return 0 on success, or -1 (with errno set to ENOMEM) if memory couldn't be allocated
+ */
+int run_substitutions(const char* input_string, size_t input_len, struct arena *arena, struct substitution **result) {
+    *result = NULL;
+    size_t first = 0;
+    while (first < input_len && input_string[first] == ' ') {
+        first++;
+    }
+    if (first < input_len && input_string[first] == '#') {
+        return 0;
+    }
 
-    // ensure the argv array is null-terminated and place it in the command struct
-    command_struct->argv[i] = NULL;
+    // count the substitutions first so the array can be sized exactly, then run them
+    size_t count = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        size_t substitution = 0;
+        const char *dollar = memchr(input_string, '$', input_len);
+        while (dollar != NULL) {
+            size_t i = dollar - input_string;
+            enum expansion_type type;
+            size_t text_len = read_expansion(input_string, i, input_len, &type);
+            if (type == EXPANSION_SUBSTITUTION && pass == 0) {
+                count++;
+            } else if (type == EXPANSION_SUBSTITUTION) {
+                // the command is parsed from a copy, since lines without a '$' are split in place
+                size_t command_len = text_len - 3;
+                char *command_string = arena_alloc(arena, command_len + 1);
+                if (command_string == NULL) {
+                    errno = ENOMEM;
+                    return -1;
+                }
+                memcpy(command_string, &input_string[i + 2], command_len);
+                command_string[command_len] = 0;
+                struct command *command;
+                if (parse_command(command_string, command_len, arena, &command) == -1) {
+                    return -1;
+                }
+
+                struct substitution *output = &(*result)[substitution++];
+                *output = (struct substitution) { .value = "", .len = 0 };
+                if (command != NULL) {
+                    char *captured;
+                    size_t captured_len;
+                    if (capture_command(command, &captured, &captured_len) == -1) {
+                        return -1;
+                    }
+                    while (captured_len > 0 && captured[captured_len - 1] == '\n') {
+                        captured_len--;
+                    }
+                    char *value = arena_alloc(arena, captured_len + 1);
+                    if (value == NULL) {
+                        free(captured);
+                        errno = ENOMEM;
+                        return -1;
+                    }
+                    memcpy(value, captured, captured_len);
+                    *output = (struct substitution) { .value = value, .len = captured_len };
+                    free(captured);
+                }
+            }
+            i += text_len;
+            dollar = i < input_len ? memchr(&input_string[i], '$', input_len - i) : NULL;
+        }
+
+        if (count == 0) {
+            return 0;
+        }
+        if (pass == 0) {
+            *result = arena_alloc(arena, count * sizeof(struct substitution));
+            if (*result == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+        }
+    }
+    return 0;
 }
 
 
+/** ---------------------------------------------------- lexer ---------------------------------------------------- */
+
+/**
+ * A word produced by the lexer.
+ *
+ * @property text: pointer to the (null-terminated) word, which lives in the lexer's output buffer
+ * @property len: the length of the word
+ */
+struct token {
+    char *text;
+    size_t len;
+};
+
+/**
+ * Finds the next char the lexer has to look at, i.e. the next ' ', '$' or '\n'. Runs of ordinary chars are skipped
+ * 32 (AVX2) or 16 (SSE2) bytes at a time where the target supports it, with a scalar loop for everything else.
+ *
+ * @param string the string to search
+ * @param i the index to start searching from
+ * @param len the length of the string; nothing at or past this index is read
+ * @return the index of the next special char, or len if there are none
+ */
+size_t find_special(const char* string, size_t i, size_t len) {
+#ifdef __AVX2__
+    const __m256i spaces_32 = _mm256_set1_epi8(' ');
+    const __m256i dollars_32 = _mm256_set1_epi8('$');
+    const __m256i newlines_32 = _mm256_set1_epi8('\n');
+    while (i + 32 <= len) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*) &string[i]);
+        __m256i matches = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, spaces_32), _mm256_cmpeq_epi8(chunk, dollars_32)),
+            _mm256_cmpeq_epi8(chunk, newlines_32)
+        );
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(matches);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 32;
+    }
+#endif
+#ifdef __SSE2__
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i dollars = _mm_set1_epi8('$');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    while (i + 16 <= len) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) &string[i]);
+        __m128i matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, spaces), _mm_cmpeq_epi8(chunk, dollars)),
+            _mm_cmpeq_epi8(chunk, newlines)
+        );
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+#endif
+    while (i < len && string[i] != ' ' && string[i] != '$' && string[i] != '\n') {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Ends the word being written by expand(). A word that's empty, because all it held were expansions to nothing (e.g.
+ * an unset $NAME), is dropped rather than becoming an empty arg.
+ *
+ * @param output_string the output buffer
+ * @param j the end of the word in the output buffer
+ * @param tokens the words so far, with the current one's text set
+ * @param token_count pointer to the number of words so far, to be incremented if the word is kept
+ * @return where the next word's text goes in the output buffer
+ */
+size_t end_word(char* output_string, size_t j, struct token *tokens, size_t *token_count) {
+    size_t len = &output_string[j] - tokens[*token_count].text;
+    if (len == 0) {
+        return j;
+    }
+    output_string[j] = 0;
+    tokens[*token_count].len = len;
+    (*token_count)++;
+    return j + 1;
+}
 
 /**
- * Processes and expands the input string, overwriting the output string buffer with the new contents as follows:
- *   - Any instances `$$` are replaced by this program's process id
- *   - Any instance of multiple spaces are replaced by exactly one space
- *   - Any *leading* spaces are trimmed
+ * Expands and splits the input string in a single pass, writing each word to the output buffer as its own
+ * null-terminated string (words are written back to back, separated by exactly one null terminator):
+ *   - Any instances of a special variable (e.g. `$$`) are replaced by its value from the expansion table, any
+ *     instances of a named variable (`$NAME`) by the value of the environment variable (nothing if it isn't set), and
+ *     any command substitutions (`$(command)`) by their output (see run_substitutions())
+ *   - Words are delimited by any number of spaces; leading and trailing spaces are dropped, and so are words that
+ *     expand to nothing
+ *   - The line ends at the first '\n' (or at the end of the string)
+ *
+ * The output buffer must be large enough to hold the fully expanded string, and tokens must have room for one entry
+ * per word. If the input contains no '$', the output buffer may be the input string itself (words are then compacted
+ * in place, since they can only shrink).
  *
  * @param input_string pointer to the string to be parsed
- * @param output_string pointer to a buffer to be overwritten with the new string
- * @return the new length of the input string (after expansion)
+ * @param input_len the length of the input string
+ * @param output_string pointer to a buffer to be overwritten with the words
+ * @param tokens pointer to an array to be overwritten with the words
+ * @param substitutions the outputs of the string's command substitutions, in order (NULL if they weren't run, in
+ *                      which case they expand to nothing)
+ * @return the number of words that were written
  */
-int expand(const char* input_string, char* output_string) {
-    // get the process id as a string
-    char pid_as_str[12];  // signed int + null term
-    int pid_len = sprintf(pid_as_str, "%d", getpid());
+size_t expand(const char* input_string, size_t input_len, char* output_string, struct token *tokens,
+              const struct substitution *substitutions) {
+    size_t i = 0;          // input_string
+    size_t j = 0;          // output_string
+    size_t token_count = 0;
+    bool in_word = false;  // true while tokens[token_count] is being written
 
-    int i = 0;  // input_string
-    int j = 0;  // output_string
+    while (i < input_len) {
+        size_t run_end = find_special(input_string, i, input_len);
 
-    // copy space-separated words
-    while (input_string[i] != 0) {
-        // skip whitespace (this will also skip any leading whitespace)
-        while (input_string[i] == ' ') {
-            i++;
+        // copy runs of ordinary chars wholesale; they either start or continue a word (when lexing in place, runs
+        // only need to move once an earlier run of spaces has been dropped)
+        if (run_end > i) {
+            if (!in_word) {
+                tokens[token_count].text = &output_string[j];
+                in_word = true;
+            }
+            if (&output_string[j] != &input_string[i]) {
+                memmove(&output_string[j], &input_string[i], run_end - i);
+            }
+            j += run_end - i;
+            i = run_end;
+            continue;
         }
 
-        // copy one char at a time until we reach '$', whitespace, or the end of the string
-        while (input_string[i] != ' ' && input_string[i] != '$' && input_string[i] != 0) {
-            output_string[j] = input_string[i];
+        if (input_string[i] == '\n') {
+            break;
+        }
+        if (input_string[i] == ' ') {
+            // end the current word (if there is one); repeated spaces are skipped
+            if (in_word) {
+                j = end_word(output_string, j, tokens, &token_count);
+                in_word = false;
+            }
             i++;
-            j++;
+            continue;
         }
 
-        // replace '$$' if we've found it; otherwise copy either the '$' or ' '
-        if (input_string[i] == '$' && input_string[i + 1] == '$') {
-            strncpy(&output_string[j], pid_as_str, pid_len);
-            j += pid_len;  // account for the characters we wrote
-            i += 2;        // skip second '$'
-        } else if (input_string[i] == '$') {
-            output_string[j] = input_string[i];
-            i++;
-            j++;
+        // '$' either starts or continues a word; replace it (and whatever follows it) with the value of the
+        // expansion it starts, which is just "$" if it doesn't start one; values are never split into words
+        if (!in_word) {
+            tokens[token_count].text = &output_string[j];
+            in_word = true;
         }
+        enum expansion_type type;
+        size_t text_len = read_expansion(input_string, i, input_len, &type);
+        size_t value_len;
+        const char *value = get_expansion_value(input_string, i, text_len, type, substitutions, &value_len);
+        if (type == EXPANSION_SUBSTITUTION && substitutions != NULL) {
+            substitutions++;
+        }
+        memcpy(&output_string[j], value, value_len);
+        j += value_len;  // account for the characters we wrote
+        i += text_len;   // skip the expansion's text
+    }
 
-        // we may reach whitespace either directly (after we exit the first loop that copies chars) or indirectly
-        // if it comes directly after '$$' (since we incremented i)
-        if (input_string[i] == ' ') {
-            output_string[j] = ' ';
-            i++;
-            j++;
+    // terminate the last word
+    if (in_word) {
+        end_word(output_string, j, tokens, &token_count);
+    }
+
+    return token_count;
+}
+
+
+/** ----------------------------------------------- command parser ------------------------------------------------ */
+
+/**
+ * Reads an i/o redirection operator: [n]<, [n]>, [n]>>, [n]>&m, [n]<&m, &> or &>> (where n and m are single digits)
+ * as a word of its own. &> and &>> redirect both stdout and stderr, so they produce two redirections: the file one for
+ * stdout, then 2>&1. The file names of the redirections are left unset.
+ *
+ * @param token the token to check
+ * @param redirects pointer to room for two redirections, to be overwritten with the redirections the operator makes
+ * @return the number of redirections the operator makes; 0 if the token isn't an operator
+ */
+size_t read_redirect_operator(const struct token *token, struct redirect *redirects) {
+    const char *text = token->text;
+    bool both = text[0] == '&' && text[1] == '>';
+    int fd = -1;
+    if (both) {
+        text++;
+    } else if (text[0] >= '0' && text[0] <= '9') {
+        fd = text[0] - '0';
+        text++;
+    }
+
+    char direction = *text++;
+    if (direction != '<' && direction != '>') {
+        return 0;
+    }
+    enum redirect_type type = direction == '<' ? REDIRECT_INPUT : REDIRECT_OUTPUT;
+    int source_fd = -1;
+    if (direction == '>' && text[0] == '>') {
+        type = REDIRECT_APPEND;
+        text++;
+    } else if (!both && text[0] == '&' && text[1] >= '0' && text[1] <= '9') {
+        type = REDIRECT_DUPLICATE;
+        source_fd = text[1] - '0';
+        text += 2;
+    }
+    if (*text != 0) {
+        return 0;
+    }
+
+    redirects[0] = (struct redirect) {
+        .type = type, .fd = fd != -1 ? fd : direction == '<' ? 0 : 1, .source_fd = source_fd, .file = NULL
+    };
+    if (!both) {
+        return 1;
+    }
+    redirects[1] = (struct redirect) { .type = REDIRECT_DUPLICATE, .fd = 2, .source_fd = 1, .file = NULL };
+    return 2;
+}
+
+/**
+ * Returns true if the token is the pipe operator, i.e. exactly '|'.
+ *
+ * @param token the token to check
+ */
+bool is_pipe_operator(const struct token *token) {
+    return token->len == 1 && token->text[0] == '|';
+}
+
+/**
+ * Populates the argv and redirects properties of a pipeline stage from the lexer's words, without copying any of them
+ * (argv[] and the file names hold views into the lexer's output buffer).\n\n
+ *
+ * Redirection operators (see read_redirect_operator()) are words of their own, and are never the first word of the
+ * stage. Everything between an operator that takes a file (i.e. anything but a duplication, and never the last word)
+ * and the next operator (or the end of the stage) is the name of the file, which may itself contain spaces; every
+ * other word is an arg. An operator that directly follows one taking a file leaves that one without a file, so it's
+ * dropped. Redirections are kept in order, so if the same descriptor is redirected more than once, the rightmost one
+ * wins.
+ *
+ * @param stage the stage whose argv and redirects properties are to be populated
+ * @param tokens the words of the stage (excluding any '|' or trailing '&')
+ * @param token_count the number of words
+ * @param arena the arena that owns argv[] and the redirections
+ * @return true on success, or false if memory couldn't be allocated
+ */
+bool parse_stage(struct stage *stage, struct token *tokens, size_t token_count, struct arena *arena) {
+    // allocate space for the argv[] array, which needs to be terminated by a null pointer for use with exec()
+    stage->argv = arena_alloc(arena, (token_count + 1) * sizeof(char*));
+    if (stage->argv == NULL) {
+        return false;
+    }
+
+    // most stages have no redirections at all, so only allocate room for them once one is found
+    struct redirect operator[2];
+    size_t redirect_capacity = 0;
+    for (size_t i = 1; i < token_count; i++) {
+        redirect_capacity += read_redirect_operator(&tokens[i], operator);
+    }
+    stage->redirects = NULL;
+    stage->redirect_count = 0;
+    if (redirect_capacity > 0) {
+        stage->redirects = arena_alloc(arena, redirect_capacity * sizeof(struct redirect));
+        if (stage->redirects == NULL) {
+            return false;
         }
     }
 
-    // write the null terminator
-    output_string[j] = 0;
+    size_t argc = 0;
+    struct redirect *target = NULL;  // the redirection whose file name is being read; NULL while reading args
+    size_t target_start = 0;         // the index of the first redirection made by target's operator
+    for (size_t i = 0; i < token_count; i++) {
+        size_t operator_count = i != 0 ? read_redirect_operator(&tokens[i], operator) : 0;
+        bool takes_file = operator_count > 0 && operator[0].type != REDIRECT_DUPLICATE;
+        if (operator_count > 0 && (!takes_file || i != token_count - 1)) {
+            // if this operator directly follows one that takes a file, that one didn't get a file name, so drop it
+            if (target != NULL && target->file == tokens[i].text) {
+                stage->redirect_count = target_start;
+            }
+            target = NULL;
+            target_start = stage->redirect_count;
+            for (size_t j = 0; j < operator_count; j++) {
+                stage->redirects[stage->redirect_count++] = operator[j];
+            }
+            if (takes_file) {
+                target = &stage->redirects[target_start];
+                target->file = tokens[i + 1].text;
+            }
+        } else if (target == NULL) {
+            stage->argv[argc] = tokens[i].text;
+            argc++;
+        } else if (target->file != tokens[i].text) {
+            // re-join the words of a file name; the lexer separated them with a single null terminator
+            tokens[i].text[-1] = ' ';
+        }
+    }
+
+    // ensure the argv array is null-terminated
+    stage->argv[argc] = NULL;
+    return true;
+}
+
+/**
+ * Splits the lexer's words into pipeline stages at each '|' and parses every stage. A '|' only separates stages if
+ * there is at least one word on either side of it; otherwise it is treated as an ordinary word.
+ *
+ * @param command_struct the struct whose stages are to be populated
+ * @param tokens the words of the command (excluding any trailing '&')
+ * @param token_count the number of words
+ * @param arena the arena that owns the stages
+ * @return true on success, or false if memory couldn't be allocated
+ */
+bool parse_pipeline(struct command *command_struct, struct token *tokens, size_t token_count, struct arena *arena) {
+    // count the stages first so the array can be sized exactly
+    size_t stage_count = 1;
+    size_t stage_start = 0;
+    for (size_t i = 0; i < token_count; i++) {
+        if (i > stage_start && i != token_count - 1 && is_pipe_operator(&tokens[i])) {
+            stage_count++;
+            stage_start = i + 1;
+        }
+    }
+    command_struct->stages = arena_alloc(arena, stage_count * sizeof(struct stage));
+    if (command_struct->stages == NULL) {
+        return false;
+    }
+    command_struct->stage_count = stage_count;
+
+    // then parse each of them, using the same rule to find the boundaries
+    size_t stage = 0;
+    stage_start = 0;
+    for (size_t i = 0; i < token_count; i++) {
+        if (i > stage_start && i != token_count - 1 && is_pipe_operator(&tokens[i])) {
+            if (!parse_stage(&command_struct->stages[stage], &tokens[stage_start], i - stage_start, arena)) {
+                return false;
+            }
+            stage++;
+            stage_start = i + 1;
+        }
+    }
+    return parse_stage(&command_struct->stages[stage], &tokens[stage_start], token_count - stage_start, arena);
+}
+
+
+/**
+ * Parses the number of CPUs given to limit -c, e.g. 2 or 0.5, as a quota per CGROUP_CPU_PERIOD (of at least the
+ * 1000 microseconds the kernel allows).
+ *
+ * @param text the word (null-terminated)
+ * @return the quota in microseconds, or 0 if the word isn't a positive number
+ */
+long parse_cpu_quota(const char* text) {
+    char *end = NULL;
+    double cpus = strtod(text, &end);
+    if (end == text || *end != 0 || !(cpus > 0) || cpus > LONG_MAX / CGROUP_CPU_PERIOD) {
+        return 0;
+    }
+    long quota = (long) (cpus * CGROUP_CPU_PERIOD + 0.5);
+    return quota < 1000 ? 1000 : quota;
+}
+
+/**
+ * Parses the size given to limit -m: a positive number of bytes, optionally followed by K, M or G, e.g. 512M.
+ *
+ * @param text the word (null-terminated)
+ * @return the number of bytes, or 0 if the word isn't a size
+ */
+long long parse_memory_size(const char* text) {
+    char *end = NULL;
+    errno = 0;
+    long long size = strtoll(text, &end, 10);
+    if (end == text || errno != 0 || size <= 0) {
+        return 0;
+    }
+    int shift = 0;
+    switch (*end) {
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+        default: break;
+    }
+    if (*end != 0 || size > LLONG_MAX >> shift) {
+        return 0;
+    }
+    return size << shift;
+}
+
+/**
+ * Reads the "limit" keyword and its options, i.e. limit [-c cpus] [-m size] command ... (see parse_cpu_quota() and
+ * parse_memory_size()). Like "time", it's only a keyword if there's a command for it to apply to, and only if every
+ * option is valid; otherwise the words are left alone, and "limit" is treated as an ordinary command.
+ *
+ * @param tokens the words of the command
+ * @param token_count the number of words
+ * @param limits the limits to be overwritten with the options
+ * @return the number of words taken up by the keyword and its options, or 0 if the words don't start with it
+ */
+size_t read_limits(const struct token *tokens, size_t token_count, struct command_limits *limits) {
+    if (tokens[0].len != 5 || memcmp(tokens[0].text, "limit", 5) != 0) {
+        return 0;
+    }
+    struct command_limits read = *limits;
+    size_t i = 1;
+    while (i < token_count && tokens[i].len == 2 && tokens[i].text[0] == '-'
+           && (tokens[i].text[1] == 'c' || tokens[i].text[1] == 'm')) {
+        if (i + 2 >= token_count) {
+            return 0;  // no value, or no command
+        }
+        if (tokens[i].text[1] == 'c' ? (read.cpu_quota = parse_cpu_quota(tokens[i + 1].text)) == 0
+                                     : (read.memory_max = parse_memory_size(tokens[i + 1].text)) == 0) {
+            return 0;
+        }
+        i += 2;
+    }
+    if (i == 1) {
+        return 0;
+    }
+    *limits = read;
+    return i;
+}
+
+
+/**
+ * Reads the "pin" keyword and its options, i.e. pin cpus command ..., pin -n nodes command ..., or pin -r command ...
+ * (the next NUMA node in turn), where cpus and nodes are lists like 0-7,16. Like "time", it's only a keyword if
+ * there's a command for it to apply to, and only if its list is valid; otherwise "pin" is an ordinary command.
+ *
+ * @param tokens the words of the command
+ * @param token_count the number of words
+ * @param pinning the pinning to be overwritten with the options
+ * @return the number of words taken up by the keyword and its options, or 0 if the words don't start with it
+ */
+size_t read_pinning(const struct token *tokens, size_t token_count, struct command_pinning *pinning) {
+    if (tokens[0].len != 3 || memcmp(tokens[0].text, "pin", 3) != 0 || token_count < 3) {
+        return 0;
+    }
+    if (tokens[1].len == 2 && memcmp(tokens[1].text, "-r", 2) == 0) {
+        *pinning = (struct command_pinning) { .list = NULL, .nodes = true };
+        return 2;
+    }
+    if (tokens[1].len == 2 && memcmp(tokens[1].text, "-n", 2) == 0) {
+        if (token_count < 4 || !is_pin_list(tokens[2].text, true)) {
+            return 0;
+        }
+        *pinning = (struct command_pinning) { .list = tokens[2].text, .nodes = true };
+        return 3;
+    }
+    if (!is_pin_list(tokens[1].text, false)) {
+        return 0;
+    }
+    *pinning = (struct command_pinning) { .list = tokens[1].text, .nodes = false };
+    return 2;
+}
+
+
+/**
+ * Reads the "timeout" keyword and its duration, i.e. timeout duration command ... (see parse_duration()). Like
+ * "time", it's only a keyword if there's a command for it to apply to, and only if the duration is valid; otherwise
+ * "timeout" is an ordinary command (e.g. coreutils' timeout, given options of its own).
+ *
+ * @param tokens the words of the command
+ * @param token_count the number of words
+ * @param timeout_ms the timeout to be overwritten with the duration, in milliseconds
+ * @return the number of words taken up by the keyword and its duration, or 0 if the words don't start with it
+ */
+size_t read_timeout(const struct token *tokens, size_t token_count, long *timeout_ms) {
+    if (tokens[0].len != 7 || memcmp(tokens[0].text, "timeout", 7) != 0 || token_count < 3) {
+        return 0;
+    }
+    long duration = parse_duration(tokens[1].text);
+    if (duration == 0) {
+        return 0;
+    }
+    *timeout_ms = duration;
+    return 2;
+}
+
+
+/**
+ * Expands the input (see expand()) and splits it into words, running any command substitutions first. If there is
+ * nothing to expand, the input string is mutated in the process.
+ *
+ * @param input_string pointer to the string to be split (followed by at least one writable byte, e.g. its null term)
+ * @param input_len the length of the string
+ * @param arena the arena that owns the words
+ * @param started_at when the caller started on the line; restarted once the substitutions are done, since running
+ *                   them doesn't count towards parsing it
+ * @param tokens where to store a pointer to the words
+ * @param token_count where to store the number of words
+ * @return 0 on success, or -1 (with errno set to ENOMEM) if memory couldn't be allocated
+ */
+int split_line(char* input_string, size_t input_len, struct arena *arena, struct timespec *started_at,
+               struct token **tokens, size_t *token_count) {
+    *token_count = 0;
+
+    // the line ends at the first '\n' (if there is one)
+    const char *newline = memchr(input_string, '\n', input_len);
+    if (newline != NULL) {
+        input_len = newline - input_string;
+    }
+
+    // words are separated by at least one char, so there can't be more than (n + 1) / 2 of them
+    *tokens = arena_alloc(arena, (input_len + 1) / 2 * sizeof(struct token));
+    if (*tokens == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
 
-    return j;  // we wrote j chars to the output string
+    // lines without a '$' have nothing to expand, so they're split in place; otherwise any command substitutions are
+    // run first, and the expanded words live in the arena, which is sized to fit the fully expanded line
+    char *output_string = input_string;
+    struct substitution *substitutions = NULL;
+    if (memchr(input_string, '$', input_len) != NULL) {
+        if (run_substitutions(input_string, input_len, arena, &substitutions) == -1) {
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, started_at);
+        output_string = arena_alloc(arena, measure_expansion(input_string, input_len, substitutions) + 1);
+        if (output_string == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    // expand any variables and substitutions, and split the input into words
+    struct timespec expand_start;
+    clock_gettime(CLOCK_MONOTONIC, &expand_start);
+    *token_count = expand(input_string, input_len, output_string, *tokens, substitutions);
+    record_phase(PHASE_EXPAND, expand_start);
+    return 0;
 }
 
+/**
+ * Expands the input and splits it into words like the words of a command, but without parsing them, i.e. keywords,
+ * operators (e.g. '|', '&' or '#') and redirections are ordinary words.
+ *
+ * The returned words (and the array itself) are allocated from the passed arena (or point into the input string),
+ * and are released when the arena is reset.
+ *
+ * @param input_string pointer to the string to be split (followed by at least one writable byte, e.g. its null term)
+ * @param input_len the length of the string
+ * @param arena the arena that owns the returned words
+ * @param result where to store a pointer to the null-terminated array of words
+ * @return 0 on success, or -1 (with errno set to ENOMEM) if memory couldn't be allocated
+ */
+int expand_words(char* input_string, size_t input_len, struct arena *arena, char ***result) {
+    *result = NULL;
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    struct token *tokens;
+    size_t token_count;
+    if (split_line(input_string, input_len, arena, &started_at, &tokens, &token_count) == -1) {
+        return -1;
+    }
+
+    char **words = arena_alloc(arena, (token_count + 1) * sizeof(char*));
+    if (words == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t i = 0; i < token_count; i++) {
+        words[i] = tokens[i].text;
+    }
+    words[token_count] = NULL;
+    *result = words;
+    return 0;
+}
 
 /**
  * Gets input from the specified stream and parses it to a command. Assumes the input has the following
- * format: (#|command) [arg1 arg2 ...] [(>|<) file] [(>|<) file] [&]. Any instances of `$$` are expanded
- * to the program's process id. The input string is mutated in the process.
+ * format: (#|[keyword ...] stage) [| stage ...] [&], where the keywords are time, limit, pin and timeout (see
+ * read_limits(), read_pinning() and read_timeout()) and each stage has the format: command [arg1 arg2 ...]
+ * [redirection ...], e.g. "< file", "> file", ">> file", "2> file", "2>&1" or "&> file". Any instances of `$$` are
+ * expanded to the program's process id, any instances of `$NAME` to the value of that environment variable, and any
+ * instances of `$(command)` to the output of the command, which is run (in the foreground) as the line is parsed. If
+ * there is nothing to expand, the input string is mutated in the process.
  *
- * The calling function is responsible for freeing memory allocated for the returned command struct.
+ * The returned command struct (and everything it points to) is allocated from the passed arena (or points into the
+ * input string), and is released when the arena is reset.
  *
- * @param command_string pointer to the string to be parsed
- * @return pointer to a command struct representing the command on success or NULL on failure
+ * @param input_string pointer to the string to be parsed (followed by at least one writable byte, e.g. its null term)
+ * @param input_len the length of the string
+ * @param arena the arena that owns the returned command struct
+ * @param result where to store a pointer to the command struct, or NULL if the input is blank or a comment
+ * @return 0 on success, or -1 (with errno set to ENOMEM) if memory couldn't be allocated
  */
-struct command *parse_command(char* input_string) {
-    // expand any instances of '$$' to pid, remove duplicate whitespace, and get the new length of the string
-    char command_string[MAX_INPUT_CHARS_SIZE];
+int parse_line(char* input_string, size_t input_len, struct arena *arena, struct command **result) {
+    *result = NULL;
+    struct timespec parse_start;
+    clock_gettime(CLOCK_MONOTONIC, &parse_start);
 
-    int len = expand(input_string, command_string);  // expand '$$' and trim left
-    len = truncate_right(command_string, len);        // trim right
+    // expand any variables and substitutions, and split the input into words (the parsed command points into them)
+    struct token *tokens;
+    size_t token_count;
+    if (split_line(input_string, input_len, arena, &parse_start, &tokens, &token_count) == -1) {
+        return -1;
+    }
 
     // check whether anything was entered aside from whitespace
-    if (len == 0) {
-        return NULL;
+    if (token_count == 0) {
+        return 0;
     }
 
     /**
-     * Parse the input string. At this point, the string has at least one meaningful character in it and we have
-     * already expanded any instances of '$$'. The argv portion of the command string is its most variable, but
-     * we know it'll end either before one of the other operators ('>', '<' or '&') or at the end of the input
-     * string. We also have already checked whether only whitespace was entered. So, we can proceed in this order:
-     *   1. Parse from the left and check for a leading '#' or the beginning of the command
-     *   2. Parse from the right to check for the '&' operator
-     *   3. Parse argv (The command and any args), stopping at '>', '<' or the end of the string
-     *   4. Parse i/o redirection ('>' and/or '<' in any order)
+     * Parse the words. At this point, there is at least one word and we have already expanded any instances of '$$'.
+     * So, we can proceed in this order:
+     *   1. Check for a leading '#'
+     *   2. Check for the '&' operator, which can only occur as the last word
+     *   3. Check for the "time", "limit", "pin" and "timeout" keywords, which can only occur before the first stage's
+     *      command
+     *   4. Split the pipeline into stages at each '|', then parse each stage's argv (the command and any args) and
+     *      i/o redirections ('<', '>', '>>', '2>', '2>&1', '&>' and the like, in any order)
      */
-    int left = 0;
-    int right = len - 1;
-
 
-    // (1) check whether the input is a comment (the string was already left-trimmed)
-    if (command_string[left] == '#') {
-        return NULL;
+    // (1) check whether the input is a comment
+    if (tokens[0].text[0] == '#') {
+        return 0;
     }
 
-    // create the command struct; we have at least one meaningful char
-    struct command *parsed_command = create_command_struct();
+    // create the command struct; we have at least one meaningful word
+    struct command *parsed_command = create_command_struct(arena);
     if (parsed_command == NULL) {
-        handle_memory_error();
+        errno = ENOMEM;
+        return -1;
     }
 
-    // (2) check whether this should be run as a background task; if '&' is present then it must occur at the end
-    //     however if it's the only thing that appears in the input string then we'll need to treat it as part of
-    //     the argv string (i.e. as a command), otherwise we risk breaking anything that relies on the assumption
-    //     that there is at least one entry in the command string
-    if (command_string[right] == '&' && right > left + 1 && command_string[right - 1] == ' ') {
+    // (2) check whether this should be run as a background task; if '&' is present then it must be the last word,
+    //     however if it's the only word then we'll need to treat it as part of argv (i.e. as a command), otherwise we
+    //     risk breaking anything that relies on the assumption that there is at least one entry in argv
+    if (token_count > 1 && tokens[token_count - 1].len == 1 && tokens[token_count - 1].text[0] == '&') {
         parsed_command->background = true;
-        right--;                    // move to whitespace
-        command_string[right] = 0;  // truncate so we don't parse '&' again
-        right--;                    // move over the null char
-    }
-
-    // (3) find argv (parsing and stopping if we reach an i/o redirection operator)
-    int argv_right = left;
-    while ( argv_right < right
-            && strncmp(&command_string[argv_right], " > ", 3) != 0
-            && strncmp(&command_string[argv_right], " < ", 3) != 0
-          ) {
-        argv_right++;
-    }
-    // tokenize (truncate) the argv string if we found either '>' or '<'
-    if (command_string[argv_right] == ' ') {
-        command_string[argv_right] = 0;
-        argv_right++;
-    }
-
-    parse_args(parsed_command, &command_string[left]);
-    left = argv_right;  // move to the start of the potential i/o operator string
-
-    // (4) check for the i/o redirect operators in any order; at this point, if left == right, then we didn't find
-    //     either of the operator, so only proceed if left < right; using a while loop here will allow this to work
-    //     even for cases where two of the same stream are passed (defaulting to the rightmost one)
-    while (left < right) {
-        bool redirect_input = command_string[left] == '<' ? true : false;
-
-        // skip initial whitespace
-        left ++;
-        while (command_string[left] == ' ' && left < right) {
-            left++;
+        token_count--;
+    }
+
+    // (3) check for the "time", "limit", "pin" and "timeout" keywords (in any order); like '&', they're only keywords
+    //     if there's a command for them to apply to
+    while (token_count > 1) {
+        size_t keyword_len = read_limits(tokens, token_count, &parsed_command->limits);
+        if (keyword_len == 0) {
+            keyword_len = read_pinning(tokens, token_count, &parsed_command->pinning);
         }
-        // find the end of the filename string
-        int filename_end = left;
-        while ( filename_end < right
-                && strncmp(&command_string[filename_end], " > ", 3) != 0
-                && strncmp(&command_string[filename_end], " < ", 3) != 0
-              ) {
-            filename_end++;
+        if (keyword_len == 0) {
+            keyword_len = read_timeout(tokens, token_count, &parsed_command->timeout_ms);
         }
-        // make sure there's actually something to parse aside from whitespace (for cases like " >  < filename") and
-        // trim any trailing whitespace if it exists; the filename is the input string from left to filename_end
-        if (truncate_right(&command_string[left], filename_end - left + 1) > 0) {
-            if (redirect_input) {
-                parsed_command->i_stream = calloc(filename_end - left + 1, sizeof(char));
-                strcpy(parsed_command->i_stream, &command_string[left]);
-            } else {
-                parsed_command->o_stream = calloc(filename_end - left + 1, sizeof(char));
-                strcpy(parsed_command->o_stream, &command_string[left]);
-            }
+        if (keyword_len == 0 && tokens[0].len == 4 && memcmp(tokens[0].text, "time", 4) == 0) {
+            parsed_command->timed = true;
+            keyword_len = 1;
+        }
+        if (keyword_len == 0) {
+            break;
         }
-        left = filename_end + 1;  // check for any other operators
+        tokens += keyword_len;
+        token_count -= keyword_len;
+    }
+
+    // (4) build the stages, each with its argv and redirection targets, from the remaining words
+    if (!parse_pipeline(parsed_command, tokens, token_count, arena)) {
+        errno = ENOMEM;
+        return -1;
     }
 
-    return parsed_command;
+    record_phase(PHASE_PARSE, parse_start);
+
+    *result = parsed_command;
+    return 0;
+}
+
+/**
+ * Parses a line like parse_line(), and records the parsed command in the trace (if tracing is on). Lines that are
+ * parsed ahead of when they run (e.g. the body of a loop) should be parsed with parse_line() instead, and traced when
+ * they run.
+ *
+ * @param input_string pointer to the string to be parsed (followed by at least one writable byte, e.g. its null term)
+ * @param input_len the length of the string
+ * @param arena the arena that owns the returned command struct
+ * @param result where to store a pointer to the command struct, or NULL if the input is blank or a comment
+ * @return 0 on success, or -1 (with errno set to ENOMEM) if memory couldn't be allocated
+ */
+int parse_command(char* input_string, size_t input_len, struct arena *arena, struct command **result) {
+    if (parse_line(input_string, input_len, arena, result) == -1) {
+        return -1;
+    }
+    if (*result != NULL) {
+        trace_command(*result);
+    }
+    return 0;
 }
@@ -1,29 +1,107 @@
 /*
  * Author: Donato Quartuccia
  * Description: Header for public functions of parsers.c
- *              Last Modified: 1/29/2022
+ *              Last Modified: 10/14/2026
  */
 
 #ifndef SMALLSH_PARSERS_H
 #define SMALLSH_PARSERS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+
+/**
+ * The kinds of i/o redirection: [n]< file, [n]> file, [n]>> file and [n]>&m (or [n]<&m).
+ */
+enum redirect_type {
+    REDIRECT_INPUT,
+    REDIRECT_OUTPUT,
+    REDIRECT_APPEND,
+    REDIRECT_DUPLICATE
+};
+
+/**
+ * A struct that holds one i/o redirection of a stage.
+ *
+ * @property type: the kind of redirection
+ * @property fd: the descriptor of the process that is redirected
+ * @property source_fd: for REDIRECT_DUPLICATE, the descriptor m of the process that fd becomes a copy of; -1 otherwise
+ * @property file: string containing the file name; NULL for REDIRECT_DUPLICATE
+ */
+struct redirect {
+    enum redirect_type type;
+    int fd;
+    int source_fd;
+    char *file;
+};
+
 /**
- * A struct that holds command info. Should be initialized with create_command_struct()
+ * A struct that holds the info for one process of a pipeline.
  *
  * @property argv: pointer to an array of strings; argv[0] = command
+ * @property redirects: pointer to an array of redirections, applied in order (so the rightmost one for a descriptor
+ *                      wins); NULL if there are none
+ * @property redirect_count: the number of redirections
+ */
+struct stage {
+    char **argv;
+    struct redirect *redirects;
+    size_t redirect_count;
+};
+
+/**
+ * The resource limits of a command, applied to all of its processes together (see the "limit" keyword).
+ *
+ * @property cpu_quota: the CPU time the command may use per CGROUP_CPU_PERIOD, in microseconds; 0 => unlimited
+ * @property memory_max: the memory the command may use, in bytes; 0 => unlimited
+ */
+struct command_limits {
+    long cpu_quota;
+    long long memory_max;
+};
+
+/**
+ * Where the processes of a command run (see the "pin" keyword).
+ *
+ * @property list: the CPUs (e.g. "0-7,16"), or with nodes, the NUMA nodes to run on; NULL => the next node in turn
+ *                 with nodes, or wherever the shell runs without
+ * @property nodes: true if the processes are pinned to NUMA nodes, i.e. to their CPUs and memory
+ */
+struct command_pinning {
+    const char *list;
+    bool nodes;
+};
+
+/**
+ * A struct that holds command info: a pipeline of one or more stages, where each stage's stdout is connected to the
+ * next stage's stdin. Should be initialized with create_command_struct(); its memory (including the stages, their
+ * argv[] and the stream names) belongs to the arena it was created in
+ *
+ * @property stages: pointer to an array of stages, in pipeline order
+ * @property stage_count: the number of stages (at least 1)
  * @property background: true if the command should be run as a background task, false otherwise
- * @property i_stream: string containing the input stream; NULL => unset
- * @property o_stream: string containing the output stream name; NULL => unset
+ * @property timed: true if the command was prefixed with "time", i.e. its resource usage should be printed
+ * @property limits: the limits the command was given with the "limit" keyword, if any
+ * @property pinning: where the command was pinned with the "pin" keyword, if anywhere
+ * @property timeout_ms: how long the command may run (see the "timeout" keyword), in milliseconds; 0 => the shell's
+ *                       default (see get_default_timeout())
  */
 struct command {
-    char **argv;
+    struct stage *stages;
+    size_t stage_count;
     bool background;
-    char *i_stream;
-    char *o_stream;
+    bool timed;
+    struct command_limits limits;
+    struct command_pinning pinning;
+    long timeout_ms;
 };
 
-struct command *parse_command(char* command_string);
-void delete_command_struct(struct command *command_struct);
+void set_expansion(char name, int value);
+void init_expansions();
+int parse_line(char* input_string, size_t input_len, struct arena *arena, struct command **result);
+int parse_command(char* input_string, size_t input_len, struct arena *arena, struct command **result);
+int expand_words(char* input_string, size_t input_len, struct arena *arena, char ***result);
 void print_command_struct(struct command *command_struct);
 
 
@@ -0,0 +1,281 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains a cache (a hash table, similar to bash's `hash`) that maps command names to the absolute paths
+ *              they resolve to in PATH, so that launching a command doesn't have to search PATH every time.
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // strchrnul
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "path_cache.h"
+
+
+/**
+ * An entry in the cache. Deleted entries keep their slot (as a tombstone) so that probe sequences stay intact.
+ *
+ * @property command: the command name; NULL => the slot has never been used
+ * @property path: the absolute path the command resolves to; NULL => the entry was deleted
+ * @property hash: the hash of the command name
+ * @property hits: the number of times the entry was used
+ */
+struct path_entry {
+    char *command;
+    char *path;
+    uint32_t hash;
+    unsigned int hits;
+};
+
+static struct path_entry *entries = NULL;  // open-addressed table with linear probing
+static size_t capacity = 0;                // always a power of two (or zero before the first insertion)
+static size_t used = 0;                    // slots that aren't empty (live entries and tombstones)
+static char *cached_path_variable = NULL;  // the value of PATH the entries were resolved against
+static char *uncached_path = NULL;         // the last path that couldn't be added to the table (out of memory)
+
+
+/** ---------------------------------------------------- table ---------------------------------------------------- */
+
+/**
+ * Hashes a string with 32-bit FNV-1a.
+ *
+ * @param string the string to hash
+ * @return the hash of the string
+ */
+uint32_t hash_string(const char* string) {
+    uint32_t hash = 2166136261u;
+    while (*string != 0) {
+        hash ^= (unsigned char) *string;
+        hash *= 16777619u;
+        string++;
+    }
+    return hash;
+}
+
+/**
+ * Finds the slot that holds the command, or the slot it would be inserted into if it's not in the table. The table
+ * must have been allocated.
+ *
+ * @param command the command name
+ * @param hash the hash of the command name
+ * @return a pointer to the slot
+ */
+struct path_entry *find_slot(const char* command, uint32_t hash) {
+    struct path_entry *first_tombstone = NULL;
+    size_t mask = capacity - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        struct path_entry *entry = &entries[i];
+        if (entry->command == NULL) {
+            return first_tombstone != NULL ? first_tombstone : entry;
+        }
+        if (entry->path == NULL) {
+            if (first_tombstone == NULL) {
+                first_tombstone = entry;
+            }
+        } else if (entry->hash == hash && strcmp(entry->command, command) == 0) {
+            return entry;
+        }
+    }
+}
+
+/**
+ * Frees every entry and empties the table (keeping its capacity).
+ */
+void clear_command_paths() {
+    for (size_t i = 0; i < capacity; i++) {
+        free(entries[i].command);
+        free(entries[i].path);
+        entries[i].command = NULL;
+        entries[i].path = NULL;
+    }
+    used = 0;
+}
+
+/**
+ * Makes sure there is room for one more entry, doubling the table (and dropping its tombstones) once it's 3/4 full.
+ *
+ * @return true on success, or false if the table needed to grow and memory couldn't be allocated (it's left as is)
+ */
+bool reserve_slot() {
+    if (capacity != 0 && (used + 1) * 4 <= capacity * 3) {
+        return true;
+    }
+
+    struct path_entry *old_entries = entries;
+    size_t old_capacity = capacity;
+
+    size_t new_capacity = capacity == 0 ? PATH_CACHE_INITIAL_SIZE : capacity * 2;
+    struct path_entry *new_entries = calloc(new_capacity, sizeof(struct path_entry));
+    if (new_entries == NULL) {
+        return false;
+    }
+    entries = new_entries;
+    capacity = new_capacity;
+    used = 0;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].path != NULL) {
+            *find_slot(old_entries[i].command, old_entries[i].hash) = old_entries[i];
+            used++;
+        } else {
+            free(old_entries[i].command);  // tombstone
+        }
+    }
+    free(old_entries);
+    return true;
+}
+
+
+/** --------------------------------------------------- lookups --------------------------------------------------- */
+
+/**
+ * Empties the cache if PATH has changed since the entries were resolved.
+ *
+ * @param path_variable the current value of PATH
+ */
+void check_path_variable(const char* path_variable) {
+    if (cached_path_variable != NULL && strcmp(cached_path_variable, path_variable) == 0) {
+        return;
+    }
+    clear_command_paths();
+    free(cached_path_variable);
+    cached_path_variable = strdup(path_variable);  // if this fails, the (empty) cache is simply cleared again next time
+}
+
+/**
+ * Searches each directory in path_variable (in order) for an executable regular file named command. An empty
+ * directory in the list stands for the working directory.
+ *
+ * @param command the command name
+ * @param path_variable a colon-separated list of directories
+ * @return a newly allocated string with the path to the executable, or NULL if none was found (or, with errno set to
+ *         ENOMEM, if memory couldn't be allocated)
+ */
+char *search_path(const char* command, const char* path_variable) {
+    size_t command_len = strlen(command);
+    const char *directory = path_variable;
+    while (true) {
+        const char *directory_end = strchrnul(directory, ':');
+        size_t directory_len = directory_end - directory;
+
+        // build "<directory>/<command>" (or just "<command>" for the working directory)
+        char *candidate = malloc(directory_len + command_len + 2);
+        if (candidate == NULL) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        size_t len = 0;
+        if (directory_len > 0) {
+            memcpy(candidate, directory, directory_len);
+            candidate[directory_len] = '/';
+            len = directory_len + 1;
+        }
+        memcpy(&candidate[len], command, command_len + 1);
+
+        struct stat file_info;
+        if (stat(candidate, &file_info) == 0 && S_ISREG(file_info.st_mode) && (file_info.st_mode & 0111) != 0) {
+            return candidate;
+        }
+        free(candidate);
+
+        if (*directory_end == 0) {
+            return NULL;
+        }
+        directory = directory_end + 1;
+    }
+}
+
+/**
+ * Resolves a command name to the path of the executable it refers to, searching PATH only if the command isn't
+ * already in the cache. Names that contain a '/' are paths already and are returned as is. The cache is emptied
+ * whenever PATH changes.
+ *
+ * @param command the command name
+ * @return the path to the executable (owned by the cache; valid until the cache changes), or NULL if the command
+ *         couldn't be found (errno is ENOMEM if that's because memory couldn't be allocated)
+ */
+const char *lookup_command_path(const char* command) {
+    if (strchr(command, '/') != NULL) {
+        return command;
+    }
+    const char *path_variable = getenv("PATH");
+    if (path_variable == NULL) {
+        path_variable = DEFAULT_PATH;
+    }
+    check_path_variable(path_variable);
+
+    uint32_t hash = hash_string(command);
+    if (capacity != 0) {
+        struct path_entry *entry = find_slot(command, hash);
+        if (entry->path != NULL) {
+            entry->hits++;
+            return entry->path;
+        }
+    }
+
+    // cache misses aren't remembered, so a command that gets installed later is found the next time
+    char *path = search_path(command, path_variable);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    // if there's no memory to cache the path, it's still returned (and kept until the next lookup)
+    char *command_copy = reserve_slot() ? strdup(command) : NULL;
+    if (command_copy == NULL) {
+        free(uncached_path);
+        uncached_path = path;
+        return path;
+    }
+    struct path_entry *entry = find_slot(command, hash);
+    if (entry->command == NULL) {
+        used++;  // (a tombstone's slot is already counted)
+    }
+    free(entry->command);
+    entry->command = command_copy;
+    entry->path = path;
+    entry->hash = hash;
+    entry->hits = 1;
+    return path;
+}
+
+/**
+ * Removes a command from the cache, e.g. because the executable it resolved to no longer exists.
+ *
+ * @param command the command name
+ */
+void forget_command_path(const char* command) {
+    if (capacity == 0) {
+        return;
+    }
+    struct path_entry *entry = find_slot(command, hash_string(command));
+    if (entry->path != NULL) {
+        free(entry->path);
+        entry->path = NULL;  // leave the name in place as a tombstone
+    }
+}
+
+/**
+ * Prints every cached command and the number of times it was used, in the same format as bash's `hash`.
+ */
+void print_command_paths() {
+    bool empty = true;
+    for (size_t i = 0; i < capacity; i++) {
+        if (entries[i].path != NULL) {
+            if (empty) {
+                printf("hits\tcommand\n");
+                empty = false;
+            }
+            printf("%4u\t%s\n", entries[i].hits, entries[i].path);
+        }
+    }
+    if (empty) {
+        printf("hash: hash table empty\n");
+    }
+    fflush(stdout);
+}
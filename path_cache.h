@@ -0,0 +1,15 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of path_cache.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_PATH_CACHE_H
+#define SMALLSH_PATH_CACHE_H
+
+const char *lookup_command_path(const char* command);
+void forget_command_path(const char* command);
+void clear_command_paths();
+void print_command_paths();
+
+#endif //SMALLSH_PATH_CACHE_H
@@ -0,0 +1,231 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the line reader the shell reads its input with. Lines are handed to the parser as views into
+ *              the reader's own memory, so they're never copied into a line buffer (and never go through stdio):
+ *                * A script that's a regular file is mapped from its descriptor's offset (privately, so the parser
+ *                  can still split lines in place), and the offset is moved past what was read once the reader is
+ *                  done. The kernel is told it's read sequentially, the next READER_PREFETCH_SIZE bytes are
+ *                  requested ahead of the current line, and pages the reader is done with are released, so even huge
+ *                  generated scripts are read at the speed of the page cache without being resident all at once.
+ *                * Anything else (pipes, terminals, sockets) is read into a buffer READER_BLOCK_SIZE bytes at a time,
+ *                  which grows to fit the longest line. A read returns whatever is available, so terminals and
+ *                  sockets still get an answer to every line as soon as it arrives.
+ *
+ *              Each line is null-terminated (its newline is overwritten), and is only valid until the next call to
+ *              read_line().
+ *              Last Modified: 10/14/2026
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "reader.h"
+
+
+/** --------------------------------------------------- readers --------------------------------------------------- */
+
+/**
+ * Creates a line reader for a descriptor, which is mapped if it's a regular file with something left to read. The
+ * descriptor isn't owned by the reader; reading starts at its current offset, which is moved past whatever was read
+ * when the reader is deleted (so the descriptor can be shared, e.g. a script piped into the shell's stdin).
+ *
+ * @param fd the descriptor to read lines from
+ * @return a pointer to the reader, or NULL (with errno set to ENOMEM) if memory couldn't be allocated
+ */
+struct line_reader *create_line_reader(int fd) {
+    struct line_reader *reader = malloc(sizeof(struct line_reader));
+    if (reader == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    *reader = (struct line_reader) { .fd = fd };
+
+    // map regular files from the page the descriptor's offset is in; if they can't be (e.g. there's nothing left to
+    // read, or the rest is too large for the address space), stream them
+    struct stat file_stat;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && offset != -1 && offset < file_stat.st_size) {
+        off_t page_size = sysconf(_SC_PAGESIZE);
+        off_t map_offset = offset / page_size * page_size;
+        size_t size = file_stat.st_size - map_offset;
+        void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, map_offset);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            reader->data = data;
+            reader->size = reader->end = size;
+            reader->start = offset - map_offset;
+            reader->offset = map_offset;
+            reader->mapped = true;
+            return reader;
+        }
+    }
+
+    reader->data = malloc(READER_BLOCK_SIZE);
+    if (reader->data == NULL) {
+        free(reader);
+        errno = ENOMEM;
+        return NULL;
+    }
+    reader->size = READER_BLOCK_SIZE;
+    return reader;
+}
+
+/**
+ * Deletes a line reader (but doesn't close its descriptor). The descriptor of a mapped file is left just past the last
+ * line that was read.
+ *
+ * @param reader the reader to delete
+ */
+void delete_line_reader(struct line_reader *reader) {
+    if (reader->mapped) {
+        lseek(reader->fd, reader->offset + (off_t) reader->start, SEEK_SET);
+        munmap(reader->data, reader->size);
+    } else {
+        free(reader->data);
+    }
+    free(reader->tail);
+    free(reader);
+}
+
+/**
+ * Returns true if a whole line can be read without waiting on the descriptor.
+ *
+ * @param reader the reader
+ */
+bool has_buffered_line(const struct line_reader *reader) {
+    if (reader->mapped) {
+        return reader->start < reader->end;
+    }
+    return memchr(&reader->data[reader->start], '\n', reader->end - reader->start) != NULL;
+}
+
+
+/** ---------------------------------------------------- lines ---------------------------------------------------- */
+
+/**
+ * Keeps the window of the mapped file around the current line resident: once the next line starts less than
+ * READER_PREFETCH_SIZE / 2 bytes from the end of what's been requested so far, the next READER_PREFETCH_SIZE bytes
+ * are requested, and whole pages more than READER_PREFETCH_SIZE bytes before the current line are released. Released
+ * pages only held lines that have already been parsed (and copied wherever they're kept).
+ *
+ * @param reader the reader (of a mapped file)
+ * @param line_start the offset of the line that was just read
+ */
+void advance_window(struct line_reader *reader, size_t line_start) {
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    if (reader->prefetched < reader->end && reader->start + READER_PREFETCH_SIZE / 2 >= reader->prefetched) {
+        size_t offset = reader->prefetched / page_size * page_size;
+        size_t len = reader->end - offset < READER_PREFETCH_SIZE ? reader->end - offset : READER_PREFETCH_SIZE;
+        madvise(&reader->data[offset], len, MADV_WILLNEED);
+        reader->prefetched = offset + len;
+    }
+    if (line_start >= reader->released + 2 * READER_PREFETCH_SIZE) {
+        size_t release_end = (line_start - READER_PREFETCH_SIZE) / page_size * page_size;
+        madvise(&reader->data[reader->released], release_end - reader->released, MADV_DONTNEED);
+        reader->released = release_end;
+    }
+}
+
+/**
+ * Reads the next line of a mapped file.
+ *
+ * @param reader the reader
+ * @param line where to store a pointer to the line
+ * @return the length of the line, or -1 at the end of the file (or if memory couldn't be allocated for its last line)
+ */
+ssize_t read_mapped_line(struct line_reader *reader, char **line) {
+    if (reader->start >= reader->end) {
+        return -1;
+    }
+    size_t line_start = reader->start;
+    char *start = &reader->data[line_start];
+    size_t remaining = reader->end - line_start;
+    char *newline = memchr(start, '\n', remaining);
+    size_t len = newline != NULL ? (size_t) (newline - start) : remaining;
+    reader->start += newline != NULL ? len + 1 : len;
+
+    if (newline != NULL) {
+        *newline = 0;
+        *line = start;
+    } else {
+        // the last line has no newline to overwrite, and may end exactly at the end of the mapping, so copy it
+        reader->tail = malloc(len + 1);
+        if (reader->tail == NULL) {
+            return -1;
+        }
+        memcpy(reader->tail, start, len);
+        reader->tail[len] = 0;
+        *line = reader->tail;
+    }
+    advance_window(reader, line_start);
+    return (ssize_t) len;
+}
+
+/**
+ * Reads the next line from a descriptor that isn't mapped, reading more of it into the buffer (in blocks of up to the
+ * buffer's free space) until a whole line is there.
+ *
+ * @param reader the reader
+ * @param line where to store a pointer to the line
+ * @return the length of the line, or -1 at the end of the input (or if memory couldn't be allocated for the line)
+ */
+ssize_t read_buffered_line(struct line_reader *reader, char **line) {
+    while (true) {
+        char *start = &reader->data[reader->start];
+        char *newline = memchr(start, '\n', reader->end - reader->start);
+        if (newline != NULL) {
+            *newline = 0;
+            *line = start;
+            reader->start += newline - start + 1;
+            return newline - start;
+        }
+
+        // move the partial line to the front of the buffer (growing it if the line fills it), then read more
+        if (reader->start > 0) {
+            memmove(reader->data, start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+        if (reader->end + 1 >= reader->size) {
+            char *data = realloc(reader->data, reader->size * 2);
+            if (data == NULL) {
+                return -1;
+            }
+            reader->data = data;
+            reader->size *= 2;
+        }
+        ssize_t count = read(reader->fd, &reader->data[reader->end], reader->size - reader->end - 1);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            // whatever's left over (if anything) is the last line; a terminal can be read from again after ^D, so the
+            // end of the input isn't remembered
+            size_t len = reader->end - reader->start;
+            if (len == 0) {
+                return -1;
+            }
+            reader->data[reader->end] = 0;
+            reader->start = reader->end;
+            *line = reader->data;
+            return (ssize_t) len;
+        }
+        reader->end += count;
+    }
+}
+
+/**
+ * Reads the next line, without its newline.
+ *
+ * @param reader the reader
+ * @param line where to store a pointer to the (null-terminated) line, which is valid until the next call
+ * @return the length of the line, or -1 at the end of the input (or if memory couldn't be allocated for the line)
+ */
+ssize_t read_line(struct line_reader *reader, char **line) {
+    return reader->mapped ? read_mapped_line(reader, line) : read_buffered_line(reader, line);
+}
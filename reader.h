@@ -0,0 +1,48 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of reader.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_READER_H
+#define SMALLSH_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Reads lines from a descriptor, handing out views into its own memory instead of copies. Regular files are mapped;
+ * anything else (pipes, terminals, sockets) is read into a buffer in large blocks. Should be initialized with
+ * create_line_reader()
+ *
+ * @property fd: the descriptor lines are read from
+ * @property data: the mapped file, or the buffer
+ * @property size: the size of the mapped part of the file, or of the buffer
+ * @property start: the offset of the first unread byte
+ * @property end: the offset just past the last byte read into the buffer (the size of the mapping when mapped)
+ * @property offset: the offset in the file the mapping starts at (the start of the page the reader started in)
+ * @property mapped: true if data is the mapped file
+ * @property prefetched: the offset up to which the mapped file has been read in ahead of time
+ * @property released: the offset up to which the pages of the mapped file have been released
+ * @property tail: a copy of the last line of the mapped file, if it doesn't end with a newline
+ */
+struct line_reader {
+    int fd;
+    char *data;
+    size_t size;
+    size_t start;
+    size_t end;
+    off_t offset;
+    bool mapped;
+    size_t prefetched;
+    size_t released;
+    char *tail;
+};
+
+struct line_reader *create_line_reader(int fd);
+ssize_t read_line(struct line_reader *reader, char **line);
+bool has_buffered_line(const struct line_reader *reader);
+void delete_line_reader(struct line_reader *reader);
+
+#endif //SMALLSH_READER_H
@@ -0,0 +1,723 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the interpreter, which runs parsed command lines (as built-ins, or with run_command()) and
+ *              control flow blocks. A line that starts with if, while or for opens a block, which is read up to its
+ *              closing fi or done and compiled into a tree of statements before any of it runs, so loops run their
+ *              bodies from the tree instead of reading and parsing them again on every iteration:
+ *                * if command ... [elif command ...] [else ...] fi    runs the first branch whose command succeeds
+ *                * while command ... done                             runs the body for as long as the command succeeds
+ *                * for NAME in word ... done                          runs the body once per word, with the
+ *                                                                     environment variable NAME set to the word
+ *                * break, continue                                    leave the innermost loop, or start its next
+ *                                                                     iteration
+ *
+ *              Every keyword starts a line of its own; then and do are optional, either on a line of their own or as a
+ *              trailing "; then" or "; do". A condition is an ordinary command line, which succeeds if the status it
+ *              leaves behind (the one the status built-in prints) is an exit value of 0; the words of a for loop are
+ *              expanded like the args of a command, but aren't otherwise parsed (e.g. '|' is a word). Lines whose parse
+ *              can't change are parsed once, as the block is compiled; any other line (e.g. one using $NAME) is parsed
+ *              each time it runs, so that it sees the current values of its variables.
+ *
+ *              A foreground process terminated by ^C stops the whole block. A syntax error discards the rest of the
+ *              block without running any of it.
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // W_EXITCODE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "smallsh.h"
+#include "builtins.h"
+#include "error_handlers.h"
+#include "trace.h"
+#include "reader.h"
+#include "script.h"
+
+/**
+ * The keywords of the control flow syntax; each one is only a keyword as the first word of a line.
+ */
+enum keyword {
+    KEYWORD_NONE,
+    KEYWORD_IF,
+    KEYWORD_THEN,
+    KEYWORD_ELIF,
+    KEYWORD_ELSE,
+    KEYWORD_FI,
+    KEYWORD_WHILE,
+    KEYWORD_FOR,
+    KEYWORD_DO,
+    KEYWORD_DONE,
+    KEYWORD_BREAK,
+    KEYWORD_CONTINUE
+};
+
+static const char *keywords[] = {
+    [KEYWORD_IF] = "if", [KEYWORD_THEN] = "then", [KEYWORD_ELIF] = "elif", [KEYWORD_ELSE] = "else",
+    [KEYWORD_FI] = "fi", [KEYWORD_WHILE] = "while", [KEYWORD_FOR] = "for", [KEYWORD_DO] = "do",
+    [KEYWORD_DONE] = "done", [KEYWORD_BREAK] = "break", [KEYWORD_CONTINUE] = "continue"
+};
+
+#define KEYWORD_COUNT (sizeof(keywords) / sizeof(keywords[0]))
+#define KEYWORD_BIT(keyword) (1u << (keyword))
+
+enum node_type {
+    NODE_COMMAND,
+    NODE_IF,
+    NODE_WHILE,
+    NODE_FOR,
+    NODE_BREAK,
+    NODE_CONTINUE
+};
+
+/**
+ * A compiled statement. Commands, conditions (of if and while) and the words of a for loop all keep their line, and
+ * the command parsed from it if its parse can't change.
+ *
+ * @property type: the kind of statement
+ * @property next: the statement that follows this one in the same list; NULL => last
+ * @property line: the (null-terminated) command line, condition or words (in the compiler's arena)
+ * @property line_len: the length of line
+ * @property command: the command parsed from line at compile time, or NULL if it's parsed each time it runs
+ * @property variable: the name of the loop variable (for only)
+ * @property body: the statements run if the condition succeeds (if), or on every iteration (while and for)
+ * @property else_body: the statements run if the condition fails (if only), including any elif as a nested if
+ */
+struct node {
+    enum node_type type;
+    struct node *next;
+    char *line;
+    size_t line_len;
+    struct command *command;
+    char *variable;
+    struct node *body;
+    struct node *else_body;
+};
+
+/**
+ * The state of a compilation.
+ *
+ * @property input: the reader the rest of the block is read from
+ * @property interactive: true to prompt for every line of the block
+ * @property line: the line being compiled (a view into the reader, valid until the next line is read)
+ * @property arena: the arena that owns the compiled statements
+ * @property depth: the number of blocks that are open, i.e. waiting on their fi or done
+ * @property loop_depth: the number of loops that are open
+ */
+struct compiler {
+    struct line_reader *input;
+    bool interactive;
+    char *line;
+    struct arena *arena;
+    int depth;
+    int loop_depth;
+};
+
+/**
+ * What should happen once a statement has run.
+ */
+enum flow {
+    FLOW_NEXT,       // run the next statement
+    FLOW_BREAK,      // leave the innermost loop
+    FLOW_CONTINUE,   // start the next iteration of the innermost loop
+    FLOW_STOP,       // stop running the block (^C)
+    FLOW_EXIT        // stop running the block and exit the shell
+};
+
+static struct arena *statement_arena = NULL;  // backs the commands parsed while a block runs
+
+
+/** --------------------------------------------------- commands -------------------------------------------------- */
+
+/**
+ * Runs a parsed command: exit, a built-in, or else the command itself in the foreground or background. Built-ins are
+ * only recognized as standalone commands; in a pipeline, every stage is an executable.
+ *
+ * @param parsed_command the command to run
+ * @return how running the command ended
+ */
+enum command_outcome run_parsed_command(struct command *parsed_command) {
+    char *command_name = parsed_command->stages[0].argv[0];
+    bool standalone = parsed_command->stage_count == 1;
+    bool in_background = parsed_command->background && get_foreground_flag() != 1;
+
+    // "time" measures whatever runs in the foreground, built-ins included; the CPU times and max RSS are those
+    // recorded by the command, if it started any processes
+    bool timed = parsed_command->timed && !in_background;
+    struct timespec started_at;
+    if (timed) {
+        clock_gettime(CLOCK_MONOTONIC, &started_at);
+        clear_command_usage();
+    }
+
+    // check whether to exit (which ends the shell, so it isn't a built-in like the others)
+    if (standalone && strcmp(command_name, "exit") == 0) {
+        return COMMAND_EXIT;
+    }
+    // check whether to call a built-in, otherwise run the command in the foreground or background
+    enum command_outcome outcome = COMMAND_DONE;
+    if (!run_builtin(parsed_command, in_background)) {
+        if (run_command(parsed_command, in_background) == -1) {
+            handle_memory_error();
+        }
+        int status = get_exit_status();
+        if (!in_background && WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+            outcome = COMMAND_INTERRUPTED;
+        }
+    }
+
+    if (timed) {
+        report_command_time(started_at);
+    }
+    return outcome;
+}
+
+/**
+ * Reaps and reports any background processes that have terminated, like the shell does between lines, so that a
+ * long-running block doesn't leave them as zombies.
+ */
+void report_background_children() {
+    sigset_t sigchld_set;
+    sigemptyset(&sigchld_set);
+    sigaddset(&sigchld_set, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &sigchld_set, NULL);
+    sigprocmask(SIG_BLOCK, &sigchld_set, NULL);
+    report_child_events();
+}
+
+
+/** ---------------------------------------------------- lexer ---------------------------------------------------- */
+
+/**
+ * Reads the keyword a line starts with.
+ *
+ * @param line the (null-terminated) line
+ * @param rest where to store a pointer to whatever follows the keyword and the spaces after it, or NULL
+ * @return the keyword, or KEYWORD_NONE if the first word of the line isn't one
+ */
+enum keyword read_keyword(const char* line, const char **rest) {
+    while (*line == ' ') {
+        line++;
+    }
+    size_t len = strcspn(line, " ");
+    for (size_t keyword = 1; keyword < KEYWORD_COUNT; keyword++) {
+        if (strlen(keywords[keyword]) == len && memcmp(line, keywords[keyword], len) == 0) {
+            if (rest != NULL) {
+                *rest = line + len + strspn(line + len, " ");
+            }
+            return (enum keyword) keyword;
+        }
+    }
+    return KEYWORD_NONE;
+}
+
+/**
+ * Returns true if the line starts with a control flow keyword, i.e. if it has to be run with run_block().
+ *
+ * @param line the line
+ * @param line_len the length of the line
+ */
+bool is_block_start(const char* line, size_t line_len) {
+    // every keyword is shorter than this, so the first word can be checked without copying the whole line
+    char start[16];
+    size_t len = line_len < sizeof(start) - 1 ? line_len : sizeof(start) - 1;
+    memcpy(start, line, len);
+    start[len] = 0;
+    return read_keyword(start, NULL) != KEYWORD_NONE;
+}
+
+/**
+ * Returns the length of a condition (or list of words) without any trailing spaces, or trailing "; then" (or "; do").
+ *
+ * @param text the (null-terminated) condition
+ * @param separator "then" or "do"
+ * @return the length of the condition
+ */
+size_t trim_condition(const char* text, const char* separator) {
+    size_t len = strlen(text);
+    while (len > 0 && text[len - 1] == ' ') {
+        len--;
+    }
+    size_t separator_len = strlen(separator);
+    if (len < separator_len || memcmp(&text[len - separator_len], separator, separator_len) != 0) {
+        return len;
+    }
+    size_t end = len - separator_len;
+    while (end > 0 && text[end - 1] == ' ') {
+        end--;
+    }
+    if (end == 0 || text[end - 1] != ';') {
+        return len;
+    }
+    end--;
+    while (end > 0 && text[end - 1] == ' ') {
+        end--;
+    }
+    return end;
+}
+
+
+/** --------------------------------------------------- compiler -------------------------------------------------- */
+
+/**
+ * Prints a syntax error to stderr.
+ *
+ * @param message the problem
+ * @param keyword the keyword the problem is with
+ */
+void report_syntax_error(const char* message, enum keyword keyword) {
+    fprintf(stderr, "Error. Syntax error: %s %s\n", message, keywords[keyword]);
+}
+
+/**
+ * Reads the next line of the block into the compiler's line.
+ *
+ * @param compiler the compiler
+ * @return true on success, or false at the end of the input
+ */
+bool read_block_line(struct compiler *compiler) {
+    if (compiler->interactive) {
+        printf("> ");
+        fflush(stdout);
+    }
+    return read_line(compiler->input, &compiler->line) != -1;
+}
+
+/**
+ * Creates a statement in the compiler's arena, with a copy of its line, which is parsed right away if its parse
+ * can't change.
+ *
+ * @param compiler the compiler
+ * @param type the kind of statement
+ * @param text the line of the statement
+ * @param text_len the length of the line
+ * @return a pointer to the statement
+ */
+struct node *create_node(struct compiler *compiler, enum node_type type, const char* text, size_t text_len) {
+    struct node *node = arena_alloc(compiler->arena, sizeof(struct node));
+    char *line = arena_alloc(compiler->arena, text_len + 1);
+    if (node == NULL || line == NULL) {
+        handle_memory_error();
+    }
+    memcpy(line, text, text_len);
+    line[text_len] = 0;
+    *node = (struct node) { .type = type, .line = line, .line_len = text_len };
+
+    // the line is only needed again if it has to be parsed again, so it's fine for the parse to split it in place;
+    // the words of a for loop aren't a command, so they're only ever expanded (see run_for()), and the command isn't
+    // traced until it runs (see get_node_command())
+    if (type != NODE_FOR && has_fixed_parse(line, text_len)
+        && parse_line(line, text_len, compiler->arena, &node->command) == -1) {
+        handle_memory_error();
+    }
+    return node;
+}
+
+/**
+ * Creates a statement that requires a command (e.g. the condition of an if), which must not be blank.
+ *
+ * @param compiler the compiler
+ * @param type the kind of statement
+ * @param keyword the keyword that introduced the command
+ * @param text the command
+ * @param text_len the length of the command
+ * @return a pointer to the statement, or NULL if the command is blank (which is reported)
+ */
+struct node *create_condition_node(struct compiler *compiler, enum node_type type, enum keyword keyword,
+                                   const char* text, size_t text_len) {
+    if (text_len == 0 || text[0] == '#') {
+        report_syntax_error("missing command after", keyword);
+        return NULL;
+    }
+    return create_node(compiler, type, text, text_len);
+}
+
+bool compile_statement(struct compiler *compiler, const char* text, struct node **result);
+
+/**
+ * Compiles statements, one per line, until a line that starts with one of the closing keywords.
+ *
+ * @param compiler the compiler
+ * @param closers the keywords that close the list (KEYWORD_BIT(keyword) for each of them)
+ * @param closer where to store the keyword that closed the list
+ * @param rest where to store a pointer to whatever follows the closing keyword (in the compiler's line)
+ * @param result where to store a pointer to the first statement of the list, or NULL if it's empty
+ * @return true on success, or false on a syntax error (which is reported)
+ */
+bool compile_list(struct compiler *compiler, unsigned int closers, enum keyword *closer, const char **rest,
+                  struct node **result) {
+    struct node **tail = result;
+    *result = NULL;
+    while (read_block_line(compiler)) {
+        enum keyword keyword = read_keyword(compiler->line, rest);
+        if (keyword != KEYWORD_NONE && (closers & KEYWORD_BIT(keyword))) {
+            *closer = keyword;
+            return true;
+        }
+        if (!compile_statement(compiler, compiler->line, tail)) {
+            return false;
+        }
+        while (*tail != NULL) {
+            tail = &(*tail)->next;
+        }
+    }
+    fprintf(stderr, "Error. Syntax error: unexpected end of input\n");
+    return false;
+}
+
+/**
+ * Checks that nothing follows a keyword that ends a line (e.g. fi).
+ *
+ * @param keyword the keyword
+ * @param rest whatever follows the keyword
+ * @return true if nothing does, or false (which is reported) otherwise
+ */
+bool check_line_end(enum keyword keyword, const char* rest) {
+    if (*rest != 0) {
+        report_syntax_error("unexpected text after", keyword);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Compiles an if statement (or the elif that continues one) up to and including its fi. The if must already be
+ * counted as an open block.
+ *
+ * @param compiler the compiler
+ * @param keyword KEYWORD_IF or KEYWORD_ELIF
+ * @param condition the (null-terminated) condition
+ * @param result where to store a pointer to the statement
+ * @return true on success, or false on a syntax error (which is reported)
+ */
+bool compile_if(struct compiler *compiler, enum keyword keyword, const char* condition, struct node **result) {
+    struct node *node = create_condition_node(compiler, NODE_IF, keyword, condition, trim_condition(condition, "then"));
+    if (node == NULL) {
+        return false;
+    }
+    *result = node;
+
+    enum keyword closer;
+    const char *rest;
+    unsigned int closers = KEYWORD_BIT(KEYWORD_ELIF) | KEYWORD_BIT(KEYWORD_ELSE) | KEYWORD_BIT(KEYWORD_FI);
+    if (!compile_list(compiler, closers, &closer, &rest, &node->body)) {
+        return false;
+    }
+    if (closer == KEYWORD_ELIF) {
+        // an elif is an if nested in the else branch of the one before it, which is closed by the same fi
+        return compile_if(compiler, KEYWORD_ELIF, rest, &node->else_body);
+    }
+    if (closer == KEYWORD_ELSE && (!check_line_end(KEYWORD_ELSE, rest)
+            || !compile_list(compiler, KEYWORD_BIT(KEYWORD_FI), &closer, &rest, &node->else_body))) {
+        return false;
+    }
+    compiler->depth--;
+    return check_line_end(KEYWORD_FI, rest);
+}
+
+/**
+ * Compiles the body of a loop up to and including its done. The loop must already be counted as an open block.
+ *
+ * @param compiler the compiler
+ * @param node the loop statement
+ * @return true on success, or false on a syntax error (which is reported)
+ */
+bool compile_loop_body(struct compiler *compiler, struct node *node) {
+    compiler->loop_depth++;
+    enum keyword closer;
+    const char *rest;
+    if (!compile_list(compiler, KEYWORD_BIT(KEYWORD_DONE), &closer, &rest, &node->body)) {
+        return false;
+    }
+    compiler->loop_depth--;
+    compiler->depth--;
+    return check_line_end(KEYWORD_DONE, rest);
+}
+
+/**
+ * Compiles a for loop, i.e. "NAME in word ...", its body and its done. The loop must already be counted as an open
+ * block.
+ *
+ * @param compiler the compiler
+ * @param header the (null-terminated) text after the for keyword
+ * @param result where to store a pointer to the statement
+ * @return true on success, or false on a syntax error (which is reported)
+ */
+bool compile_for(struct compiler *compiler, const char* header, struct node **result) {
+    size_t name_len = strcspn(header, " ");
+    bool valid_name = name_len > 0 && (header[0] < '0' || header[0] > '9');
+    for (size_t i = 0; i < name_len; i++) {
+        char c = header[i];
+        valid_name = valid_name && (c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9'));
+    }
+    const char *words = header + name_len + strspn(header + name_len, " ");
+    if (!valid_name || strncmp(words, "in", 2) != 0 || (words[2] != ' ' && words[2] != 0)) {
+        fprintf(stderr, "Error. Syntax error: expected for NAME in word ...\n");
+        return false;
+    }
+    words += 2 + strspn(words + 2, " ");
+
+    // the words are kept as a line of their own, which is what gets expanded (and split) when the loop starts
+    struct node *node = create_node(compiler, NODE_FOR, words, trim_condition(words, "do"));
+    node->variable = arena_alloc(compiler->arena, name_len + 1);
+    if (node->variable == NULL) {
+        handle_memory_error();
+    }
+    memcpy(node->variable, header, name_len);
+    node->variable[name_len] = 0;
+    *result = node;
+    return compile_loop_body(compiler, node);
+}
+
+/**
+ * Compiles a statement: a command line, or a whole block if the line opens one (in which case the rest of the block
+ * is read from the input).
+ *
+ * @param compiler the compiler
+ * @param text the (null-terminated) line
+ * @param result where to store a pointer to the statement, or NULL if there's nothing to run (e.g. a comment)
+ * @return true on success, or false on a syntax error (which is reported)
+ */
+bool compile_statement(struct compiler *compiler, const char* text, struct node **result) {
+    *result = NULL;
+    const char *rest;
+    enum keyword keyword = read_keyword(text, &rest);
+
+    // a block is open as soon as its keyword is read, so a syntax error in its header still discards all of it (up
+    // to its fi or done) instead of running its body
+    if (keyword == KEYWORD_IF || keyword == KEYWORD_WHILE || keyword == KEYWORD_FOR) {
+        compiler->depth++;
+    }
+    switch (keyword) {
+        case KEYWORD_NONE: {
+            struct node *node = create_node(compiler, NODE_COMMAND, text, strlen(text));
+            if (node->command != NULL || !has_fixed_parse(text, strlen(text))) {
+                *result = node;  // otherwise it's blank or a comment
+            }
+            return true;
+        }
+        case KEYWORD_THEN:
+        case KEYWORD_DO:
+            // both are optional, so whatever follows them is a statement of its own
+            return compile_statement(compiler, rest, result);
+        case KEYWORD_IF:
+            return compile_if(compiler, KEYWORD_IF, rest, result);
+        case KEYWORD_WHILE:
+            *result = create_condition_node(compiler, NODE_WHILE, KEYWORD_WHILE, rest, trim_condition(rest, "do"));
+            return *result != NULL && compile_loop_body(compiler, *result);
+        case KEYWORD_FOR:
+            return compile_for(compiler, rest, result);
+        case KEYWORD_BREAK:
+        case KEYWORD_CONTINUE:
+            if (compiler->loop_depth == 0) {
+                report_syntax_error("not in a loop:", keyword);
+                return false;
+            }
+            *result = create_node(compiler, keyword == KEYWORD_BREAK ? NODE_BREAK : NODE_CONTINUE, "", 0);
+            return check_line_end(keyword, rest);
+        default:
+            report_syntax_error("unexpected", keyword);
+            return false;
+    }
+}
+
+/**
+ * Discards the rest of a block after a syntax error, i.e. reads lines until every block that was open is closed (or
+ * the input ends).
+ *
+ * @param compiler the compiler
+ */
+void skip_block(struct compiler *compiler) {
+    while (compiler->depth > 0 && read_block_line(compiler)) {
+        enum keyword keyword = read_keyword(compiler->line, NULL);
+        if (keyword == KEYWORD_IF || keyword == KEYWORD_WHILE || keyword == KEYWORD_FOR) {
+            compiler->depth++;
+        } else if (keyword == KEYWORD_FI || keyword == KEYWORD_DONE) {
+            compiler->depth--;
+        }
+    }
+}
+
+
+/** --------------------------------------------------- executor -------------------------------------------------- */
+
+/**
+ * Gets the command of a statement, parsing its line if it wasn't parsed at compile time.
+ *
+ * @param node the statement
+ * @return a pointer to the command, or NULL if the line is blank once expanded
+ */
+struct command *get_node_command(struct node *node) {
+    if (node->command != NULL) {
+        trace_command(node->command);
+        return node->command;
+    }
+    // the line has a '$' in it, so it isn't split in place, and can be parsed again every time
+    struct command *command;
+    reset_arena(statement_arena);
+    if (parse_command(node->line, node->line_len, statement_arena, &command) == -1) {
+        handle_memory_error();
+    }
+    return command;
+}
+
+/**
+ * Runs the command of a statement (e.g. the condition of an if).
+ *
+ * @param node the statement
+ * @return FLOW_NEXT, or FLOW_STOP or FLOW_EXIT if the command was interrupted or was exit
+ */
+enum flow run_node_command(struct node *node) {
+    report_background_children();
+    struct command *command = get_node_command(node);
+    if (command == NULL) {
+        return FLOW_NEXT;
+    }
+    enum command_outcome outcome = run_parsed_command(command);
+    return outcome == COMMAND_EXIT ? FLOW_EXIT : outcome == COMMAND_INTERRUPTED ? FLOW_STOP : FLOW_NEXT;
+}
+
+/**
+ * Returns true if the most recent command succeeded, i.e. exited with a value of 0.
+ */
+bool succeeded() {
+    return get_exit_status() == 0;
+}
+
+enum flow run_list(struct node *node);
+
+/**
+ * Runs a for loop.
+ *
+ * @param node the loop statement
+ * @return what should happen once the loop is done
+ */
+enum flow run_for(struct node *node) {
+    // the words are only expanded and split on blanks, so e.g. '|', '<' or "time" are words like any other; since a
+    // line without a '$' is split in place, it's split from a copy
+    reset_arena(statement_arena);
+    char *line = arena_alloc(statement_arena, node->line_len + 1);
+    if (line == NULL) {
+        handle_memory_error();
+    }
+    memcpy(line, node->line, node->line_len + 1);
+    char **argv;
+    if (expand_words(line, node->line_len, statement_arena, &argv) == -1) {
+        handle_memory_error();
+    }
+
+    // the words are overwritten by whatever the body parses, so copy them (and all of their chars) into one block
+    size_t word_count = 0;
+    size_t size = sizeof(char*);
+    while (argv[word_count] != NULL) {
+        size += sizeof(char*) + strlen(argv[word_count]) + 1;
+        word_count++;
+    }
+    char **words = malloc(size);
+    if (words == NULL) {
+        handle_memory_error();
+    }
+    char *chars = (char*) &words[word_count + 1];
+    for (size_t i = 0; i < word_count; i++) {
+        words[i] = chars;
+        chars = stpcpy(chars, argv[i]) + 1;
+    }
+    words[word_count] = NULL;
+
+    enum flow flow = FLOW_NEXT;
+    for (size_t i = 0; i < word_count && flow != FLOW_BREAK && flow != FLOW_STOP && flow != FLOW_EXIT; i++) {
+        if (setenv(node->variable, words[i], 1) == -1) {
+            handle_memory_error();
+        }
+        flow = run_list(node->body);
+    }
+    free(words);
+    return flow == FLOW_STOP || flow == FLOW_EXIT ? flow : FLOW_NEXT;
+}
+
+/**
+ * Runs a statement.
+ *
+ * @param node the statement
+ * @return what should happen once the statement is done
+ */
+enum flow run_statement(struct node *node) {
+    enum flow flow;
+    switch (node->type) {
+        case NODE_COMMAND:
+            return run_node_command(node);
+        case NODE_IF:
+            flow = run_node_command(node);
+            return flow != FLOW_NEXT ? flow : run_list(succeeded() ? node->body : node->else_body);
+        case NODE_WHILE:
+            while ((flow = run_node_command(node)) == FLOW_NEXT && succeeded()) {
+                flow = run_list(node->body);
+                if (flow != FLOW_NEXT && flow != FLOW_CONTINUE) {
+                    break;
+                }
+            }
+            return flow == FLOW_STOP || flow == FLOW_EXIT ? flow : FLOW_NEXT;
+        case NODE_FOR:
+            return run_for(node);
+        case NODE_BREAK:
+            return FLOW_BREAK;
+        case NODE_CONTINUE:
+            return FLOW_CONTINUE;
+    }
+    return FLOW_NEXT;
+}
+
+/**
+ * Runs a list of statements, until one of them breaks out of it.
+ *
+ * @param node the first statement of the list, or NULL
+ * @return what should happen once the list is done
+ */
+enum flow run_list(struct node *node) {
+    for (; node != NULL; node = node->next) {
+        enum flow flow = run_statement(node);
+        if (flow != FLOW_NEXT) {
+            return flow;
+        }
+    }
+    return FLOW_NEXT;
+}
+
+/**
+ * Compiles the block a line opens, reading the rest of it from the input, then runs it. If the block has a syntax
+ * error, the rest of it is discarded and the exit status is set to 2.
+ *
+ * @param line the line that opens the block (see is_block_start())
+ * @param line_len the length of the line
+ * @param input the reader the rest of the block is read from
+ * @param interactive true to prompt for the rest of the block
+ * @param arena the arena that owns the compiled block, which must not be reset until the block is done
+ * @return true if the block ran exit, false otherwise
+ */
+bool run_block(const char* line, size_t line_len, struct line_reader *input, bool interactive, struct arena *arena) {
+    if (statement_arena == NULL && (statement_arena = create_arena(LINE_ARENA_SIZE)) == NULL) {
+        handle_memory_error();
+    }
+    struct compiler compiler = { .input = input, .interactive = interactive, .arena = arena };
+    char *first_line = arena_alloc(arena, line_len + 1);
+    if (first_line == NULL) {
+        handle_memory_error();
+    }
+    memcpy(first_line, line, line_len);
+    first_line[line_len] = 0;
+
+    struct node *block;
+    bool compiled = compile_statement(&compiler, first_line, &block);
+    if (!compiled) {
+        skip_block(&compiler);
+        set_exit_status(W_EXITCODE(2, 0));
+    }
+    return compiled && run_list(block) == FLOW_EXIT;
+}
@@ -0,0 +1,29 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of script.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_SCRIPT_H
+#define SMALLSH_SCRIPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+#include "parsers.h"
+#include "reader.h"
+
+/**
+ * How running a command ended.
+ */
+enum command_outcome {
+    COMMAND_DONE,          // it ran (or was started in the background)
+    COMMAND_INTERRUPTED,   // it ran in the foreground and was terminated by ^C
+    COMMAND_EXIT           // it was the exit built-in
+};
+
+enum command_outcome run_parsed_command(struct command *parsed_command);
+bool is_block_start(const char* line, size_t line_len);
+bool run_block(const char* line, size_t line_len, struct line_reader *input, bool interactive, struct arena *arena);
+
+#endif //SMALLSH_SCRIPT_H
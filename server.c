@@ -0,0 +1,191 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the server mode (smallsh -s socket [-o]), in which one long-lived shell accepts command lines
+ *              over a Unix domain socket instead of being started again for every batch of commands.
+ *
+ *              Every connection gets its own session: a fork of the already initialized shell, in its own process
+ *              group, that reads command lines from the connection exactly as the shell reads a script, so
+ *              foreground & background processes, built-ins, $$, $! and the job table all work per connection.
+ *              After each line, the session sends back a status record: a record separator (\036) followed by the
+ *              line the status built-in would print, e.g. "\036exit value 0\n" or "\036terminated by signal 9\n".
+ *              With -o, the session's stdout and stderr (and so the output of the commands it runs) are sent over
+ *              the connection too, ahead of each record; otherwise they stay those of the server. Commands read
+ *              stdin from /dev/null. The session ends, terminating its processes, when the client closes the
+ *              connection (or sends exit).
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // accept4, ppoll
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "parsers.h"
+#include "parse_cache.h"
+#include "commands.h"
+#include "signal_handlers.h"
+#include "error_handlers.h"
+#include "trace.h"
+#include "server.h"
+
+
+/** -------------------------------------------------- listening -------------------------------------------------- */
+
+/**
+ * Creates the server socket, replacing any stale socket file at socket_path.
+ *
+ * @param socket_path the path to listen on
+ * @return the listening socket, or -1 (with an error message) if it can't be created
+ */
+int open_server_socket(char* socket_path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path is too long\n", socket_path);
+        fflush(stderr);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_fd == -1) {
+        handle_file_error(socket_path, false);
+        return -1;
+    }
+    unlink(socket_path);
+    if (bind(server_fd, (struct sockaddr*) &address, sizeof(address)) == -1 || listen(server_fd, SERVER_BACKLOG) == -1) {
+        handle_file_error(socket_path, false);
+        close(server_fd);
+        return -1;
+    }
+    return server_fd;
+}
+
+/**
+ * Sets up the process of a new session: its own process group (so that exit only terminates the session's
+ * processes), its own $$, /dev/null as stdin, and (if stream_output is true) the connection as stdout & stderr.
+ *
+ * @param session_fd the connection
+ * @param stream_output true to send the session's output over the connection
+ */
+void start_session(int session_fd, bool stream_output) {
+    setsid();
+    set_expansion('$', getpid());
+    clear_parse_cache();  // any cached $$ is the server's
+    detach_trace();
+
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+    if (stream_output) {
+        fflush(stdout);
+        fflush(stderr);
+        dup2(session_fd, STDOUT_FILENO);
+        dup2(session_fd, STDERR_FILENO);
+    }
+}
+
+/**
+ * Listens on socket_path and forks a session for every connection. Only returns in a session (or if the socket
+ * can't be created); the server itself runs until it's terminated, and reports each session that ends the way the
+ * shell reports a background process. SIGCHLD must be blocked by the caller.
+ *
+ * @param socket_path the path of the Unix domain socket to listen on
+ * @param stream_output true to send each session's stdout & stderr over its connection
+ * @return the connection (close-on-exec), in the process of the session that will serve it, or -1 if the server
+ *         couldn't be started
+ */
+int accept_sessions(char* socket_path, bool stream_output) {
+    int server_fd = open_server_socket(socket_path);
+    if (server_fd == -1) {
+        return -1;
+    }
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+
+    sigset_t wait_mask;
+    sigprocmask(SIG_BLOCK, NULL, &wait_mask);
+    sigdelset(&wait_mask, SIGCHLD);
+
+    struct pollfd poll_fds[2] = {
+        { .fd = server_fd, .events = POLLIN },
+        { .fd = get_child_event_fd(), .events = POLLIN }
+    };
+
+    while (true) {
+        int ready = ppoll(poll_fds, 2, NULL, &wait_mask);
+        if (ready == -1) {
+            continue;  // a signal was handled; ended sessions are picked up through the child event pipe
+        }
+        if (poll_fds[1].revents & POLLIN) {
+            clear_child_events();
+        }
+        // report every session that has ended before forking, so that no new session inherits them
+        report_child_events();
+        if (!(poll_fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        int session_fd = accept4(server_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (session_fd == -1) {
+            continue;  // e.g. the client gave up before being accepted
+        }
+        fflush(stdout);
+        pid_t session_pid = fork();
+        if (session_pid == 0) {
+            close(server_fd);
+            start_session(session_fd, stream_output);
+            return session_fd;
+        }
+        close(session_fd);
+        if (session_pid == -1) {
+            handle_fork_error();
+        } else {
+            printf("Session PID %d started\n", session_pid);
+            fflush(stdout);
+        }
+    }
+}
+
+
+/** -------------------------------------------------- sessions --------------------------------------------------- */
+
+/**
+ * Sends the exit status of the most recent foreground command to the client, as a status record. Output the session
+ * has buffered is sent first, so the record always follows the output of the line it's for.
+ *
+ * @param session_fd the connection
+ */
+void report_session_status(int session_fd) {
+    fflush(stdout);
+    fflush(stderr);
+
+    int wait_status = get_exit_status();
+    char record[SESSION_STATUS_SIZE];
+    int len = WIFSIGNALED(wait_status)
+        ? snprintf(record, sizeof(record), "\036terminated by signal %d\n", WTERMSIG(wait_status))
+        : snprintf(record, sizeof(record), "\036exit value %d\n", WEXITSTATUS(wait_status));
+
+    const char *next = record;
+    while (len > 0) {
+        ssize_t written = send(session_fd, next, len, MSG_NOSIGNAL);  // a closed connection mustn't raise SIGPIPE
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;  // the client went away; the session ends when it reads the end of the connection
+        }
+        next += written;
+        len -= written;
+    }
+}
@@ -0,0 +1,15 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of server.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_SERVER_H
+#define SMALLSH_SERVER_H
+
+#include <stdbool.h>
+
+int accept_sessions(char* socket_path, bool stream_output);
+void report_session_status(int session_fd);
+
+#endif //SMALLSH_SERVER_H
@@ -1,14 +1,26 @@
 /*
  * Author: Donato Quartuccia
  * Description: Contains signal handlers and setters.
- *              Last Modified: 2/8/2022
+ *              Last Modified: 10/14/2026
  */
 
+#define _GNU_SOURCE  // pipe2, wait4
+
 #include <unistd.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <stdbool.h>
 #include <errno.h>
+#include "config.h"
+#include "commands.h"
+#include "jobs.h"
+#include "trace.h"
+#include "cgroups.h"
 #include "signal_handlers.h"
 
 
@@ -19,6 +31,29 @@ void SIGTSTP_handler_foreground_only_mode(int signal_number);
 /** ---------------------------------------------------- Flags ----------------------------------------------------- */
 
 static volatile sig_atomic_t foreground_flag = 0;   // set if foreground only mode is active
+static int child_event_pipe[2] = {-1, -1};          // self-pipe; written to whenever a child is reaped
+
+/**
+ * A child process reaped by the SIGCHLD handler that hasn't been reported yet.
+ *
+ * @property pid: the pid of the process
+ * @property wait_status: the status returned by wait4()
+ * @property usage: the resources used by the process, as returned by wait4()
+ * @property reaped_at: when the process was reaped (CLOCK_MONOTONIC)
+ */
+struct child_event {
+    pid_t pid;
+    int wait_status;
+    struct rusage usage;
+    struct timespec reaped_at;
+};
+
+// single-producer, single-consumer ring: only the handler advances the head and only the main program advances the
+// tail, so neither needs a lock; both count up forever and are reduced modulo the (power of two) size on access
+static struct child_event child_events[CHILD_EVENT_RING_SIZE];
+static atomic_size_t child_events_head = 0;
+static atomic_size_t child_events_tail = 0;
+static volatile sig_atomic_t child_events_overflowed = 0;  // set if the handler left children unreaped
 
 /**
  * Returns the value of foreground_flag.
@@ -27,80 +62,158 @@ sig_atomic_t get_foreground_flag() {
     return foreground_flag;
 }
 
-/** --------------------------------------------------- SIGCHLD ---------------------------------------------------- */
+/**
+ * Returns the read end of the child event pipe, which becomes readable whenever SIGCHLD_handler has reaped (and
+ * queued) at least one child process. Meant to be polled alongside the input stream.
+ */
+int get_child_event_fd() {
+    return child_event_pipe[0];
+}
 
 /**
- * Helper function for SIGCHLD_handler. Prints an integer to stdout using only async-safe write calls.
+ * Drains the child event pipe.
  *
- * @param value the integer to be printed
+ * @return true if any child processes were reaped since the last call, false otherwise
  */
-void write_int(int value) {
-    char buffer[10];  // we'll be printing these one at a time, so the null terminator is unnecessary; digits only
-    int i = 9;
+bool clear_child_events() {
+    char buffer[64];
+    bool had_events = false;
+    while (read(child_event_pipe[0], buffer, sizeof(buffer)) > 0) {
+        had_events = true;
+    }
+    return had_events;
+}
+
+/** --------------------------------------------------- SIGCHLD ---------------------------------------------------- */
 
-    // handle edge case (we still want to print zero)
-    if (value == 0) {
-        buffer[0] = '0';
-        write(STDOUT_FILENO, buffer, 1);
-        return;
+/**
+ * Formats the termination status of a background process, e.g.:
+ *   Background PID 1234 is done: exit value 0
+ *
+ * @param buffer the buffer to write to
+ * @param size the size of buffer
+ * @param child_pid the pid of the process
+ * @param child_exit_status the status returned by waitpid()
+ * @return the length of the line (including the newline)
+ */
+int format_background_status(char* buffer, size_t size, pid_t child_pid, int child_exit_status) {
+    // WIFSIGNALED & WIFEXITED are mutually exclusive, but there are other possible states here (continued or
+    // stopped), so those just get the first half of the line
+    if (WIFEXITED(child_exit_status)) {
+        return snprintf(buffer, size, "Background PID %d is done: exit value %d\n",
+            child_pid, WEXITSTATUS(child_exit_status));
+    } else if (WIFSIGNALED(child_exit_status)) {
+        return snprintf(buffer, size, "Background PID %d is done: terminated by signal %d\n",
+            child_pid, WTERMSIG(child_exit_status));
     }
+    return snprintf(buffer, size, "Background PID %d is done: \n", child_pid);
+}
+
+/**
+ * Prints the termination status of a background process that was reaped outside of the SIGCHLD handler.
+ *
+ * @param child_pid the pid of the process
+ * @param child_exit_status the status returned by waitpid()
+ */
+void report_background_status(pid_t child_pid, int child_exit_status) {
+    char line[CHILD_EVENT_LINE_SIZE];
+    format_background_status(line, sizeof(line), child_pid, child_exit_status);
+    fputs(line, stdout);
+    fflush(stdout);
+}
 
-    // print sign and flip the value; it *seems* C truncates toward zero, but this is here for safety
-    if (value < 0) {
-        buffer[0] = '-';
-        write(STDOUT_FILENO, buffer, 1);
-        value = -value;
+/**
+ * Prints the termination status of every child process the SIGCHLD handler has reaped since the last call. The
+ * lines are collected in a buffer and written in as few writes as possible. Must be called with SIGCHLD blocked.
+ *
+ * @return the number of processes that were reported
+ */
+size_t report_child_events() {
+    char buffer[CHILD_EVENT_BATCH_SIZE];
+    size_t len = 0;
+    size_t reported = 0;
+
+    fflush(stdout);  // anything printed earlier comes first
+    size_t tail = atomic_load_explicit(&child_events_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&child_events_head, memory_order_acquire);
+    for (; tail != head; tail++) {
+        if (sizeof(buffer) - len < CHILD_EVENT_LINE_SIZE) {
+            write(STDOUT_FILENO, buffer, len);
+            len = 0;
+        }
+        // fg reports the status of a job it waits for itself, as a foreground process's
+        struct child_event *event = &child_events[tail & (CHILD_EVENT_RING_SIZE - 1)];
+        bool background = !is_foreground_job(event->pid);
+        if (background) {
+            len += format_background_status(&buffer[len], CHILD_EVENT_LINE_SIZE, event->pid, event->wait_status);
+        }
+        trace_exit(event->pid, event->wait_status, &event->usage, event->reaped_at, background);
+        release_job_timeout(event->pid);
+        reported++;
+    }
+    atomic_store_explicit(&child_events_tail, tail, memory_order_release);
+    if (len > 0) {
+        write(STDOUT_FILENO, buffer, len);
+    }
+    if (reported > 0) {
+        release_job_cgroups();  // the cgroups of jobs that just finished are empty now
     }
 
-    // get digits (right-to-left) and write them in reverse order
-    while (value != 0) {
-        buffer[i] = (char) ('0' + value % 10);
-        value /= 10;
-        i--;
+    // the handler had to leave some children unreaped; now that there's room, have it run again as soon as SIGCHLD
+    // is unblocked
+    if (child_events_overflowed) {
+        child_events_overflowed = 0;
+        raise(SIGCHLD);
     }
-    i++; // reverse last decrement so we can start our buffer at the correct location
-    write(STDOUT_FILENO, &buffer[i], 10 - i);  // we wrote 10 - i chars
+    return reported;
 }
 
 /**
- * Handler for SIGCHLD.
+ * Handler for SIGCHLD. Reaps every child that has terminated (along with the resources it used), updates the job
+ * table, and queues the status of each one on the child event ring for report_child_events(); nothing is printed
+ * here.
  */
 void SIGCHLD_handler(__attribute__((unused)) int signal_number) {
     int save_err = errno;
+    struct timespec handler_start;
+    clock_gettime(CLOCK_MONOTONIC, &handler_start);
 
-    char* output_1 = "Background PID ";        // 15 chars
-    char* output_2 = " is done: ";             // 10 chars
-    char* exited = "exit value ";              // 11 chars
-    char* signaled = "terminated by signal ";  // 21 chars
-    char* newline = "\n";                      // 1 char
     int child_pid;
     int child_exit_status;
-
-    // wait for all terminating children
-    child_pid = waitpid(-1, &child_exit_status, WNOHANG);
-    while (child_pid > 0) {
-        // write the background PID of the terminating process
-        write(STDOUT_FILENO, output_1, 15);
-        write_int(child_pid);
-        write(STDOUT_FILENO, output_2, 10);
-
-        // write the exit value or signal number of the terminating process
-        if (WIFEXITED(child_exit_status)) {
-            // terminated normally
-            write(STDOUT_FILENO, exited, 11);
-            write_int(WEXITSTATUS(child_exit_status));
-        } else if (WIFSIGNALED(child_exit_status)) {
-            // terminated by a signal; WIFSIGNALED & WIFEXTIED are mutually exclusive, but there
-            // are other possible states here (continued or stopped), so an else if seems safer
-            write(STDOUT_FILENO, signaled, 21);
-            write_int(WTERMSIG(child_exit_status));
+    struct rusage child_usage;
+    struct timespec reaped_at;
+    bool reaped = false;
+
+    // wait for all terminating children, as long as there's room on the ring; the rest stay zombies until the ring
+    // has been drained
+    while (true) {
+        size_t head = atomic_load_explicit(&child_events_head, memory_order_relaxed);
+        if (head - atomic_load_explicit(&child_events_tail, memory_order_acquire) == CHILD_EVENT_RING_SIZE) {
+            child_events_overflowed = 1;
+            break;
+        }
+        child_pid = wait4(-1, &child_exit_status, WNOHANG, &child_usage);
+        if (child_pid <= 0) {
+            break;
         }
-        write(STDOUT_FILENO, newline, 1);
+        reaped = true;
+        clock_gettime(CLOCK_MONOTONIC, &reaped_at);
+        mark_job_done(child_pid, child_exit_status, &child_usage, reaped_at);
+
+        struct child_event *event = &child_events[head & (CHILD_EVENT_RING_SIZE - 1)];
+        event->pid = child_pid;
+        event->wait_status = child_exit_status;
+        event->usage = child_usage;
+        event->reaped_at = reaped_at;
+        atomic_store_explicit(&child_events_head, head + 1, memory_order_release);
+    }
 
-        // keep going until we're out of terminating child processes
-        child_pid = waitpid(-1, &child_exit_status, WNOHANG);
+    // wake up the main loop; the pipe is non-blocking, so if it's already full the event is simply coalesced
+    if (reaped) {
+        write(child_event_pipe[1], "", 1);
     }
 
+    record_phase(PHASE_SIGNAL, handler_start);
     errno = save_err;
 }
 
@@ -174,14 +287,18 @@ void SIGTSTP_handler_foreground_only_mode(__attribute__((unused)) int signal_num
 
 /**
  * Sets baseline signal handlers for the shell:
- *   - SIGCHLD: performs cleanup for terminated background processes
+ *   - SIGCHLD: performs cleanup for terminated background processes and signals the child event pipe
  *   - SIGTSTP: toggles foreground only mode
  *   - SIGINT: ignored
  */
 void set_initial_signal_handlers() {
+    // create the child event pipe before the SIGCHLD handler can attempt to write to it; children must not inherit
+    // it, and neither end may ever block (the write end is used from a signal handler)
+    pipe2(child_event_pipe, O_CLOEXEC | O_NONBLOCK);
+
     set_SIGTSTP_handler(0);
 
-    // set SIGCHLD to write output about terminating background processes
+    // set SIGCHLD to reap terminating background processes and queue their statuses for the main loop
     struct sigaction SIGCHLD_action = {0};
     SIGCHLD_action.sa_flags = SA_RESTART;
     sigfillset(&SIGCHLD_action.sa_mask);
@@ -199,6 +316,7 @@ void set_initial_signal_handlers() {
  * Registers signal handlers such that they are in the appropriate state in a forked process (before the use of exec):
  *   - SIGTSTP: ignored
  *   - SIGINT: ignored if background_mode is true, otherwise restored to default
+ *   - SIGCHLD: restored to default and unblocked (the shell keeps it blocked outside of waiting for input)
  *
  * @param background_mode true to set signal handlers for background processes (false for foreground processes)
  */
@@ -219,6 +337,45 @@ void set_child_signal_handlers(bool background_mode) {
     SIGCHLD_action.sa_flags = SA_RESTART;
     SIGCHLD_action.sa_handler = SIG_DFL;
     sigaction(SIGCHLD, &SIGCHLD_action, NULL);
+
+    // the signal mask survives exec, so don't hand the blocked SIGCHLD down to the new program
+    sigset_t sigchld_set;
+    sigemptyset(&sigchld_set);
+    sigaddset(&sigchld_set, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &sigchld_set, NULL);
+}
+
+/**
+ * Sets signal handlers for spawning child processes, which (unlike forked ones) can't change their own dispositions
+ * before exec and instead inherit ignored signals from the shell:
+ *   - SIGTSTP: blocked (so a ^Z arriving meanwhile stays pending) and ignored
+ *
+ * Must be paired with restore_signal_handlers_after_spawn().
+ */
+void set_spawn_signal_handlers() {
+    sigset_t sigtstp_set;
+    sigemptyset(&sigtstp_set);
+    sigaddset(&sigtstp_set, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &sigtstp_set, NULL);
+
+    struct sigaction SIGTSTP_action = {0};
+    SIGTSTP_action.sa_flags = SA_RESTART;
+    SIGTSTP_action.sa_handler = SIG_IGN;
+    sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+}
+
+/**
+ * Reverts set_spawn_signal_handlers():
+ *   - SIGTSTP: toggles foreground only mode (in whichever mode is current) and is unblocked, so any ^Z that arrived
+ *              while spawning is handled right away
+ */
+void restore_signal_handlers_after_spawn() {
+    set_SIGTSTP_handler(foreground_flag);
+
+    sigset_t sigtstp_set;
+    sigemptyset(&sigtstp_set);
+    sigaddset(&sigtstp_set, SIGTSTP);
+    sigprocmask(SIG_UNBLOCK, &sigtstp_set, NULL);
 }
 
 /**
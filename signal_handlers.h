@@ -1,19 +1,27 @@
 /*
  * Author: Donato Quartuccia
  * Description: Header for public functions of signal_handlers.c
- *              Last Modified: 2/3/2022
+ *              Last Modified: 10/14/2026
  */
 
 #ifndef SMALLSH_SIGNAL_HANDLERS_H
 #define SMALLSH_SIGNAL_HANDLERS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <signal.h>
+#include <sys/types.h>
 
 void set_initial_signal_handlers();
 void set_child_signal_handlers(bool background_mode);
+void set_spawn_signal_handlers();
+void restore_signal_handlers_after_spawn();
 void set_cleanup_signal_handlers();
 sig_atomic_t get_foreground_flag();
+int get_child_event_fd();
+bool clear_child_events();
+size_t report_child_events();
+void report_background_status(pid_t child_pid, int child_exit_status);
 
 
 #endif //SMALLSH_SIGNAL_HANDLERS_H
@@ -0,0 +1,23 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Initialization of libsmallsh (see smallsh.h)
+ *              Last Modified: 10/14/2026
+ */
+
+#include "parsers.h"
+#include "signal_handlers.h"
+#include "trace.h"
+#include "smallsh.h"
+
+
+/**
+ * Sets the signal handlers the executor relies on, builds the variable expansion table, and starts tracing (if
+ * SMALLSH_TRACE is set). Must be called once, before anything else in the library. SIGCHLD is expected to be blocked
+ * while commands are parsed and run; background processes are reaped whenever the caller unblocks it, and reported
+ * by report_child_events().
+ */
+void init_smallsh() {
+    set_initial_signal_handlers();
+    init_expansions();
+    init_trace();
+}
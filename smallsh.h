@@ -0,0 +1,37 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: The public interface of libsmallsh, the parser and executor behind smallsh, for programs that want to
+ *              run shell command lines themselves. For example:
+ *
+ *                init_smallsh();
+ *                sigset_t sigchld_set;
+ *                sigemptyset(&sigchld_set);
+ *                sigaddset(&sigchld_set, SIGCHLD);
+ *                sigprocmask(SIG_BLOCK, &sigchld_set, NULL);
+ *
+ *                struct arena *arena = create_arena(4096);
+ *                struct command *command;
+ *                if (parse_command(line, strlen(line), arena, &command) == 0 && command != NULL) {
+ *                    run_command(command, false);
+ *                    int wait_status = get_exit_status();
+ *                }
+ *                reset_arena(arena);
+ *
+ *              Nothing in the library exits the calling process: memory errors are returned (-1 with errno set to
+ *              ENOMEM), and errors running a command are reported on stderr and recorded in its exit status.
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_SMALLSH_H
+#define SMALLSH_SMALLSH_H
+
+#include "arena.h"
+#include "parsers.h"
+#include "parse_cache.h"
+#include "commands.h"
+#include "jobs.h"
+#include "signal_handlers.h"
+
+void init_smallsh();
+
+#endif //SMALLSH_SMALLSH_H
@@ -0,0 +1,417 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains command timeouts. A command started with the "timeout" keyword (or any command, if
+ *              SMALLSH_TIMEOUT is set; see config.h) gets a deadline: once it's passed, the command is sent SIGTERM,
+ *              and if it's still running TIMEOUT_KILL_DELAY_MS later, SIGKILL. A foreground command's stages are
+ *              signalled one by one (they're in the shell's process group); a background job is signalled as a
+ *              group.
+ *
+ *              Every deadline is served by one timerfd, which is always armed for the earliest one; there's no
+ *              watchdog process or thread. The deadlines are kept in a binary min-heap, so the earliest one is always
+ *              at the top, and a background job's deadline is cancelled as soon as its last stage has been reaped. Whatever the shell is waiting on also waits on the timer: the prompt (see
+ *              main.c), a foreground command and parallel (see wait_for_child()), the output of a $(command) (see
+ *              wait_for_readable()), and wait & fg (see suspend_for_child()). Without any deadlines, all of them wait
+ *              exactly as they would otherwise.
+ *              Last Modified: 10/14/2026
+ */
+
+#define _GNU_SOURCE  // wait4
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "error_handlers.h"
+#include "jobs.h"
+#include "timeouts.h"
+
+/**
+ * The deadline of a process, or of the process group of a background job.
+ *
+ * @property pid: the pid of the process, or the pgid of the group
+ * @property stages: for a group, the pids of the job's stages (for looking the job up; see is_job_group_running());
+ *                   NULL for a process
+ * @property stage_count: the number of entries in stages
+ * @property deadline: when the process is to be signalled next (CLOCK_MONOTONIC nanoseconds)
+ * @property terminated: true once SIGTERM has been sent, i.e. SIGKILL is next
+ */
+struct timeout {
+    pid_t pid;
+    pid_t *stages;
+    size_t stage_count;
+    long long deadline;
+    bool terminated;
+};
+
+static struct timeout *timeouts = NULL;  // a binary min-heap on the deadline
+static size_t timeout_count = 0;
+static size_t timeout_capacity = 0;
+static int timer_fd = -1;
+static int sigchld_fd = -1;     // reports a pending SIGCHLD while it's blocked (see wait_for_child())
+
+
+/** -------------------------------------------------- durations -------------------------------------------------- */
+
+/**
+ * Parses a duration, i.e. a positive (possibly fractional) number followed by ms, s, m or h; a number on its own is
+ * a number of seconds. E.g. 30s, 1.5m or 250ms.
+ *
+ * @param text the duration (null-terminated)
+ * @return the duration in milliseconds, or 0 if the text isn't a duration
+ */
+long parse_duration(const char* text) {
+    char *end = NULL;
+    double amount = strtod(text, &end);
+    if (end == text || !(amount > 0)) {
+        return 0;
+    }
+    double unit_ms = strcmp(end, "ms") == 0 ? 1
+        : strcmp(end, "s") == 0 || *end == 0 ? 1000
+        : strcmp(end, "m") == 0 ? 60000
+        : strcmp(end, "h") == 0 ? 3600000
+        : 0;
+    double duration_ms = amount * unit_ms;
+    if (unit_ms == 0 || duration_ms > (double) (1L << 40)) {
+        return 0;
+    }
+    return duration_ms < 1 ? 1 : (long) duration_ms;
+}
+
+/**
+ * Returns the timeout of commands that don't have one of their own, i.e. the value of SMALLSH_TIMEOUT.
+ *
+ * @return the timeout in milliseconds, or 0 if there's none (or it isn't a duration)
+ */
+long get_default_timeout() {
+    char *value = getenv(TIMEOUT_VARIABLE);
+    return value != NULL && *value != 0 ? parse_duration(value) : 0;
+}
+
+
+/** ---------------------------------------------------- timer ---------------------------------------------------- */
+
+/**
+ * Returns the current time of the monotonic clock in nanoseconds.
+ */
+long long get_monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Arms the timer for the earliest deadline (the top of the heap), or disarms it if there are none.
+ */
+void arm_timer() {
+    long long earliest = timeout_count > 0 ? timeouts[0].deadline : 0;
+    struct itimerspec setting = {0};
+    setting.it_value.tv_sec = earliest / 1000000000LL;
+    setting.it_value.tv_nsec = earliest % 1000000000LL;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &setting, NULL);
+}
+
+/**
+ * Returns the descriptor of the timer, which is readable once the earliest deadline has passed (see
+ * expire_timeouts()), or -1 if no command has had a deadline yet.
+ */
+int get_timeout_fd() {
+    return timer_fd;
+}
+
+/**
+ * Returns true if any process has a deadline.
+ */
+bool has_timeouts() {
+    return timeout_count > 0;
+}
+
+/** ---------------------------------------------------- heap ----------------------------------------------------- */
+
+/**
+ * Moves a deadline up the heap until its parent isn't later than it.
+ *
+ * @param i the position of the deadline in the heap
+ */
+void sift_timeout_up(size_t i) {
+    struct timeout timeout = timeouts[i];
+    while (i > 0 && timeouts[(i - 1) / 2].deadline > timeout.deadline) {
+        timeouts[i] = timeouts[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    timeouts[i] = timeout;
+}
+
+/**
+ * Moves a deadline down the heap until neither of its children is earlier than it.
+ *
+ * @param i the position of the deadline in the heap
+ */
+void sift_timeout_down(size_t i) {
+    struct timeout timeout = timeouts[i];
+    while (2 * i + 1 < timeout_count) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < timeout_count && timeouts[child + 1].deadline < timeouts[child].deadline) {
+            child++;
+        }
+        if (timeouts[child].deadline >= timeout.deadline) {
+            break;
+        }
+        timeouts[i] = timeouts[child];
+        i = child;
+    }
+    timeouts[i] = timeout;
+}
+
+/**
+ * Adds a deadline to the heap, and rearms the timer.
+ *
+ * @param timeout the deadline (its stages, if any, belong to the list from now on)
+ * @return true on success, or false (after printing an error) on failure
+ */
+bool insert_timeout(struct timeout timeout) {
+    if (timer_fd == -1) {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd == -1) {
+            perror("Error. timerfd_create failed");
+            fflush(stderr);
+            return false;
+        }
+    }
+    if (timeout_count == timeout_capacity) {
+        size_t capacity = timeout_capacity == 0 ? 16 : timeout_capacity * 2;
+        struct timeout *grown = realloc(timeouts, capacity * sizeof(struct timeout));
+        if (grown == NULL) {
+            report_memory_error();
+            return false;
+        }
+        timeouts = grown;
+        timeout_capacity = capacity;
+    }
+    timeouts[timeout_count++] = timeout;
+    sift_timeout_up(timeout_count - 1);
+    arm_timer();
+    return true;
+}
+
+/**
+ * Removes a deadline from the heap (without rearming the timer). The last deadline takes its place, and is moved
+ * whichever way restores the heap.
+ *
+ * @param i the position of the deadline in the heap
+ */
+void delete_timeout(size_t i) {
+    free(timeouts[i].stages);
+    timeouts[i] = timeouts[--timeout_count];
+    if (i < timeout_count) {
+        sift_timeout_down(i);
+        sift_timeout_up(i);
+    }
+}
+
+
+/** -------------------------------------------------- deadlines -------------------------------------------------- */
+
+/**
+ * Gives a foreground process a deadline.
+ *
+ * @param pid the pid of the process
+ * @param timeout_ms how long from now the deadline is, in milliseconds
+ */
+void add_timeout(pid_t pid, long timeout_ms) {
+    insert_timeout((struct timeout) {
+        .pid = pid, .stages = NULL, .stage_count = 0, .deadline = get_monotonic_ns() + timeout_ms * 1000000LL,
+        .terminated = false
+    });
+}
+
+/**
+ * Gives the process group of a background job a deadline.
+ *
+ * @param pids the pids of the job's stages; the first one leads the group
+ * @param count the number of stages
+ * @param timeout_ms how long from now the deadline is, in milliseconds
+ */
+void add_group_timeout(const pid_t *pids, size_t count, long timeout_ms) {
+    pid_t *stages = malloc(count * sizeof(pid_t));
+    if (stages == NULL) {
+        report_memory_error();
+        return;
+    }
+    memcpy(stages, pids, count * sizeof(pid_t));
+    struct timeout timeout = {
+        .pid = pids[0], .stages = stages, .stage_count = count, .deadline = get_monotonic_ns() + timeout_ms * 1000000LL,
+        .terminated = false
+    };
+    if (!insert_timeout(timeout)) {
+        free(stages);
+    }
+}
+
+/**
+ * Removes a deadline, of a process or of a group. Does nothing if there isn't one.
+ *
+ * @param pid the pid of the process, or the pgid of the group
+ * @param group true for the deadline of a group, false for a process's
+ */
+void remove_timeout(pid_t pid, bool group) {
+    for (size_t i = 0; i < timeout_count; i++) {
+        if (timeouts[i].pid == pid && (timeouts[i].stages != NULL) == group) {
+            delete_timeout(i);
+            arm_timer();
+            return;
+        }
+    }
+}
+
+/**
+ * Removes the deadline of a foreground process, e.g. once it's been reaped. Does nothing if it doesn't have one.
+ *
+ * @param pid the pid of the process
+ */
+void cancel_timeout(pid_t pid) {
+    remove_timeout(pid, false);
+}
+
+/**
+ * Removes the deadline of a background job, once its last stage has been reaped. Does nothing if it doesn't have
+ * one.
+ *
+ * @param pgid the process group of the job
+ */
+void cancel_group_timeout(pid_t pgid) {
+    remove_timeout(pgid, true);
+}
+
+/**
+ * Signals every process whose deadline has passed: SIGTERM the first time, and SIGKILL TIMEOUT_KILL_DELAY_MS later
+ * (after which its deadline is removed). A background job's group is only signalled while the job is still running,
+ * since its pgid may have been reused once it's not. Must be called with SIGCHLD blocked.
+ */
+void expire_timeouts() {
+    uint64_t expirations;
+    if (timer_fd == -1 || read(timer_fd, &expirations, sizeof(expirations)) == -1) {
+        return;  // not armed, or not expired yet
+    }
+    // the deadlines that have passed are at the top of the heap, one after another
+    long long now = get_monotonic_ns();
+    while (timeout_count > 0 && timeouts[0].deadline <= now) {
+        struct timeout *timeout = &timeouts[0];
+        bool group = timeout->stages != NULL;
+        bool running = !group || is_job_group_running(timeout->pid, timeout->stages, timeout->stage_count);
+        if (running) {
+            kill(group ? -timeout->pid : timeout->pid, timeout->terminated ? SIGKILL : SIGTERM);
+        }
+        if (running && !timeout->terminated) {
+            timeout->terminated = true;
+            timeout->deadline = now + TIMEOUT_KILL_DELAY_MS * 1000000LL;
+            sift_timeout_down(0);
+        } else {
+            delete_timeout(0);
+        }
+    }
+    arm_timer();
+}
+
+
+/** --------------------------------------------------- waiting --------------------------------------------------- */
+
+/**
+ * Waits for a child process to terminate, like wait4() (without any options), while serving the deadlines. SIGCHLD
+ * must be blocked by the caller. Without any deadlines, this is just wait4(); otherwise both the timer and a
+ * signalfd for SIGCHLD are polled. Reading the signalfd takes SIGCHLD from the pending set, so if it was taken, it's
+ * raised again before returning, for the handler to reap any background processes once SIGCHLD is unblocked.
+ *
+ * @param pid the pid of the child to wait for, or -1 for any child
+ * @param wait_status where to store the status of the child
+ * @param child_usage where to store the resources used by the child
+ * @return the pid of the child that was reaped, or -1 (with errno set) on failure
+ */
+pid_t wait_for_child(pid_t pid, int *wait_status, struct rusage *child_usage) {
+    if (!has_timeouts()) {
+        return wait4(pid, wait_status, 0, child_usage);
+    }
+    if (sigchld_fd == -1) {
+        sigset_t sigchld_set;
+        sigemptyset(&sigchld_set);
+        sigaddset(&sigchld_set, SIGCHLD);
+        sigchld_fd = signalfd(-1, &sigchld_set, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (sigchld_fd == -1) {
+            return wait4(pid, wait_status, 0, child_usage);  // the deadlines are served once it's been reaped
+        }
+    }
+
+    bool taken = false;
+    pid_t reaped;
+    while ((reaped = wait4(pid, wait_status, WNOHANG, child_usage)) == 0) {
+        struct pollfd poll_fds[2] = {
+            { .fd = sigchld_fd, .events = POLLIN },
+            { .fd = timer_fd, .events = POLLIN }
+        };
+        if (poll(poll_fds, 2, -1) == -1 && errno != EINTR) {
+            break;
+        }
+        if (poll_fds[0].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(sigchld_fd, &info, sizeof(info)) == sizeof(info)) {
+                taken = true;
+            }
+        }
+        if (poll_fds[1].revents & POLLIN) {
+            expire_timeouts();
+        }
+    }
+    if (taken) {
+        raise(SIGCHLD);
+    }
+    return reaped;
+}
+
+/**
+ * Waits for a descriptor (e.g. the pipe a $(command) is captured through) to become readable, while serving the
+ * deadlines, so that a command that's being read from is killed on time. Returns right away without any deadlines.
+ *
+ * @param fd the descriptor to wait on
+ */
+void wait_for_readable(int fd) {
+    while (has_timeouts()) {
+        struct pollfd poll_fds[2] = {
+            { .fd = fd, .events = POLLIN },
+            { .fd = timer_fd, .events = POLLIN }
+        };
+        if (poll(poll_fds, 2, -1) == -1 && errno != EINTR) {
+            return;  // let the read report the problem
+        }
+        if (poll_fds[1].revents & POLLIN) {
+            expire_timeouts();
+        }
+        if (poll_fds[0].revents != 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * Suspends the shell until a signal (e.g. SIGCHLD) is handled, like sigsuspend(), while serving the deadlines.
+ *
+ * @param wait_mask the signal mask to suspend with (i.e. with SIGCHLD unblocked)
+ */
+void suspend_for_child(const sigset_t *wait_mask) {
+    if (!has_timeouts()) {
+        sigsuspend(wait_mask);
+        return;
+    }
+    struct pollfd poll_fd = { .fd = timer_fd, .events = POLLIN };
+    if (ppoll(&poll_fd, 1, NULL, wait_mask) > 0) {
+        expire_timeouts();
+    }
+}
@@ -0,0 +1,29 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of timeouts.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_TIMEOUTS_H
+#define SMALLSH_TIMEOUTS_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+long parse_duration(const char* text);
+long get_default_timeout();
+int get_timeout_fd();
+bool has_timeouts();
+void add_timeout(pid_t pid, long timeout_ms);
+void add_group_timeout(const pid_t *pids, size_t count, long timeout_ms);
+void cancel_timeout(pid_t pid);
+void cancel_group_timeout(pid_t pgid);
+void expire_timeouts();
+void wait_for_readable(int fd);
+pid_t wait_for_child(pid_t pid, int *wait_status, struct rusage *child_usage);
+void suspend_for_child(const sigset_t *wait_mask);
+
+#endif //SMALLSH_TIMEOUTS_H
@@ -0,0 +1,404 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Contains the execution trace, an opt-in log of everything the shell runs. It's enabled by setting
+ *              SMALLSH_TRACE (see config.h) to the path of the file to append to; every record is one JSON object on
+ *              its own line:
+ *                {"event":"start","ts":0.000012345,"pid":100,"realtime":1791993600.000000000}
+ *                {"event":"command","ts":...,"stages":[{"argv":["ls"],"redirects":[{"fd":1,"op":">","file":"f"}]}],...}
+ *                {"event":"launch","ts":...,"pid":101,"path":"/bin/ls","method":"spawn","launch_ns":81234}
+ *                {"event":"exit","ts":...,"pid":101,"background":false,"exit":0,"user_us":..,"sys_us":..,...}
+ *
+ *              Timestamps (ts) are CLOCK_MONOTONIC seconds; the start record pairs one with the wall clock. Records
+ *              are appended to a preallocated buffer, and a writer thread writes it out whenever it fills up (or
+ *              every TRACE_FLUSH_INTERVAL_MS), so producing a record never waits on the disk unless both buffers
+ *              are full.
+ *              Last Modified: 10/14/2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "error_handlers.h"
+#include "trace.h"
+
+
+static int trace_fd = -1;           // the trace file; -1 => tracing is off
+static pid_t trace_owner = 0;       // the process that owns the writer thread (forked children don't)
+static pthread_t writer;
+
+// the main program appends to the active buffer; the writer thread swaps it with the spare one and writes that out
+// without holding the lock
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_wakeup;                               // the active buffer is full, or closing is set
+static pthread_cond_t buffer_swapped = PTHREAD_COND_INITIALIZER;   // the active buffer has room again
+static char *active_buffer = NULL;
+static size_t active_len = 0;
+static char *spare_buffer = NULL;
+static bool closing = false;
+
+
+/** --------------------------------------------------- writer ---------------------------------------------------- */
+
+/**
+ * Writes all of a buffer to the trace file, retrying short writes.
+ *
+ * @param buffer the data to write
+ * @param len the length of the data
+ */
+void write_trace_buffer(const char* buffer, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(trace_fd, buffer, len);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;  // nowhere to report this; the rest of the buffer is dropped
+        }
+        buffer += written;
+        len -= written;
+    }
+}
+
+/**
+ * The writer thread: writes out the active buffer whenever it fills up or the flush interval elapses, until the
+ * trace is closed.
+ *
+ * @return NULL
+ */
+void *run_trace_writer(__attribute__((unused)) void *unused) {
+    pthread_mutex_lock(&trace_lock);
+    while (true) {
+        if (active_len < TRACE_BUFFER_SIZE && !closing) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += TRACE_FLUSH_INTERVAL_MS / 1000;
+            deadline.tv_nsec += (TRACE_FLUSH_INTERVAL_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&writer_wakeup, &trace_lock, &deadline);
+        }
+        if (active_len == 0) {
+            if (closing) {
+                break;
+            }
+            continue;
+        }
+
+        char *full_buffer = active_buffer;
+        size_t full_len = active_len;
+        active_buffer = spare_buffer;
+        active_len = 0;
+        spare_buffer = full_buffer;
+        pthread_cond_signal(&buffer_swapped);
+
+        pthread_mutex_unlock(&trace_lock);
+        write_trace_buffer(full_buffer, full_len);
+        pthread_mutex_lock(&trace_lock);
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return NULL;
+}
+
+
+/** --------------------------------------------------- buffers --------------------------------------------------- */
+
+/**
+ * Appends data to the active buffer, handing it to the writer (and, only if the writer is still busy with the spare
+ * buffer, waiting for it) whenever it fills up. The caller must hold trace_lock.
+ *
+ * @param data the data to append
+ * @param len the length of the data
+ */
+void append_trace(const char* data, size_t len) {
+    while (len > 0) {
+        while (active_len == TRACE_BUFFER_SIZE) {
+            pthread_cond_signal(&writer_wakeup);
+            pthread_cond_wait(&buffer_swapped, &trace_lock);
+        }
+        size_t chunk = TRACE_BUFFER_SIZE - active_len < len ? TRACE_BUFFER_SIZE - active_len : len;
+        memcpy(&active_buffer[active_len], data, chunk);
+        active_len += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+/**
+ * Appends formatted text to the active buffer. The caller must hold trace_lock.
+ *
+ * @param format the printf-style format string (the result must fit in TRACE_FIELD_SIZE chars)
+ */
+void append_trace_format(const char* format, ...) {
+    char field[TRACE_FIELD_SIZE];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(field, sizeof(field), format, args);
+    va_end(args);
+    if (len > 0) {
+        append_trace(field, (size_t) len < sizeof(field) ? (size_t) len : sizeof(field) - 1);
+    }
+}
+
+/**
+ * Appends a string to the active buffer as a JSON string (or null). The caller must hold trace_lock.
+ *
+ * @param string the string to append; may be NULL
+ */
+void append_trace_string(const char* string) {
+    if (string == NULL) {
+        append_trace("null", 4);
+        return;
+    }
+    append_trace("\"", 1);
+    const char *run = string;  // the start of the chars that don't need escaping
+    for (; *string != 0; string++) {
+        unsigned char c = (unsigned char) *string;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        append_trace(run, string - run);
+        if (c == '"' || c == '\\') {
+            char escaped[2] = { '\\', (char) c };
+            append_trace(escaped, 2);
+        } else {
+            append_trace_format("\\u%04x", c);
+        }
+        run = string + 1;
+    }
+    append_trace(run, string - run);
+    append_trace("\"", 1);
+}
+
+/**
+ * Starts a record: takes trace_lock and appends the event name and timestamp.
+ *
+ * @param event the name of the event
+ * @param timestamp when the event happened (CLOCK_MONOTONIC)
+ */
+void begin_trace_record(const char* event, struct timespec timestamp) {
+    pthread_mutex_lock(&trace_lock);
+    append_trace_format("{\"event\":\"%s\",\"ts\":%lld.%09ld", event, (long long) timestamp.tv_sec,
+        timestamp.tv_nsec);
+}
+
+/**
+ * Finishes a record started with begin_trace_record() and releases trace_lock.
+ */
+void end_trace_record() {
+    append_trace("}\n", 2);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+
+/** ---------------------------------------------------- setup ---------------------------------------------------- */
+
+/**
+ * Turns tracing on if SMALLSH_TRACE is set: opens the trace file, allocates the buffers, starts the writer thread and
+ * writes the start record. Tracing stays off (with an error message) if the file can't be opened or the buffers can't
+ * be allocated.
+ */
+void init_trace() {
+    char *path = getenv(TRACE_VARIABLE);
+    if (path == NULL || *path == 0) {
+        return;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        handle_file_error(path, false);
+        return;
+    }
+
+    active_buffer = malloc(TRACE_BUFFER_SIZE);
+    spare_buffer = malloc(TRACE_BUFFER_SIZE);
+    if (active_buffer == NULL || spare_buffer == NULL) {
+        report_memory_error();
+        free(active_buffer);
+        free(spare_buffer);
+        close(fd);
+        return;
+    }
+    pthread_condattr_t wakeup_attributes;
+    pthread_condattr_init(&wakeup_attributes);
+    pthread_condattr_setclock(&wakeup_attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&writer_wakeup, &wakeup_attributes);
+    pthread_condattr_destroy(&wakeup_attributes);
+
+    // the writer inherits a fully blocked mask, so every signal is still handled by the main thread
+    sigset_t all_signals, previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous_mask);
+    int result = pthread_create(&writer, NULL, run_trace_writer, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+    if (result != 0) {
+        free(active_buffer);
+        free(spare_buffer);
+        close(fd);
+        return;
+    }
+
+    trace_fd = fd;
+    trace_owner = getpid();
+    atexit(close_trace);
+
+    struct timespec now, realtime;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    begin_trace_record("start", now);
+    append_trace_format(",\"pid\":%d,\"realtime\":%lld.%09ld", trace_owner, (long long) realtime.tv_sec,
+        realtime.tv_nsec);
+    end_trace_record();
+}
+
+/**
+ * Writes out whatever is left in the buffer and stops the writer thread. Registered with atexit(); does nothing in
+ * a forked child (which has no writer), or if tracing is off.
+ */
+void close_trace() {
+    if (trace_fd == -1 || getpid() != trace_owner) {
+        return;
+    }
+    pthread_mutex_lock(&trace_lock);
+    closing = true;
+    pthread_cond_signal(&writer_wakeup);
+    pthread_mutex_unlock(&trace_lock);
+    pthread_join(writer, NULL);
+
+    close(trace_fd);
+    trace_fd = -1;
+    free(active_buffer);
+    free(spare_buffer);
+}
+
+/**
+ * Turns tracing off in a forked child that keeps running commands (a server session). The writer thread, and any
+ * lock it held at the time of the fork, only exist in the parent, which still owns the buffered records.
+ */
+void detach_trace() {
+    if (trace_fd == -1) {
+        return;
+    }
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+/**
+ * Returns true if tracing is on.
+ */
+bool is_tracing() {
+    return trace_fd != -1;
+}
+
+
+/** --------------------------------------------------- records ------------------------------------------------- */
+
+/**
+ * Records a parsed command: the argv and redirections of every stage, and its flags.
+ *
+ * @param command the command
+ */
+void trace_command(struct command *command) {
+    if (trace_fd == -1) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    static const char* const operators[] = {
+        [REDIRECT_INPUT] = "<", [REDIRECT_OUTPUT] = ">", [REDIRECT_APPEND] = ">>", [REDIRECT_DUPLICATE] = ">&"
+    };
+    begin_trace_record("command", now);
+    append_trace(",\"stages\":[", 11);
+    for (size_t i = 0; i < command->stage_count; i++) {
+        struct stage *stage = &command->stages[i];
+        append_trace(i == 0 ? "{\"argv\":[" : ",{\"argv\":[", i == 0 ? 9 : 10);
+        for (char **arg = stage->argv; *arg != NULL; arg++) {
+            if (arg != stage->argv) {
+                append_trace(",", 1);
+            }
+            append_trace_string(*arg);
+        }
+        append_trace("],\"redirects\":[", 15);
+        for (size_t j = 0; j < stage->redirect_count; j++) {
+            struct redirect *redirect = &stage->redirects[j];
+            append_trace_format("%s{\"fd\":%d,\"op\":\"%s\",", j == 0 ? "" : ",", redirect->fd,
+                operators[redirect->type]);
+            if (redirect->type == REDIRECT_DUPLICATE) {
+                append_trace_format("\"to\":%d}", redirect->source_fd);
+            } else {
+                append_trace("\"file\":", 7);
+                append_trace_string(redirect->file);
+                append_trace("}", 1);
+            }
+        }
+        append_trace("]}", 2);
+    }
+    append_trace_format("],\"background\":%s,\"timed\":%s,\"cpu_quota_us\":%ld,\"memory_max\":%lld,\"timeout_ms\":%ld",
+        command->background ? "true" : "false", command->timed ? "true" : "false", command->limits.cpu_quota,
+        command->limits.memory_max, command->timeout_ms);
+    if (command->pinning.list != NULL || command->pinning.nodes) {
+        append_trace_format(",\"pin_nodes\":%s,\"pin\":", command->pinning.nodes ? "true" : "false");
+        if (command->pinning.list != NULL) {
+            append_trace_string(command->pinning.list);
+        } else {
+            append_trace("null", 4);
+        }
+    }
+    end_trace_record();
+}
+
+/**
+ * Records the launch of a process.
+ *
+ * @param pid the pid of the process
+ * @param path the path of the executable
+ * @param launch_time how long the launch took: up to the exec with posix_spawn, or up to the fork otherwise
+ * @param spawned true if the process was launched with posix_spawn, false if it was forked
+ */
+void trace_launch(pid_t pid, const char* path, struct timespec launch_time, bool spawned) {
+    if (trace_fd == -1) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    begin_trace_record("launch", now);
+    append_trace_format(",\"pid\":%d,\"path\":", pid);
+    append_trace_string(path);
+    append_trace_format(",\"method\":\"%s\",\"launch_ns\":%lld", spawned ? "spawn" : "fork",
+        (long long) launch_time.tv_sec * 1000000000LL + launch_time.tv_nsec);
+    end_trace_record();
+}
+
+/**
+ * Records that a process was reaped, with its status and the resources it used.
+ *
+ * @param pid the pid of the process
+ * @param wait_status the status returned by wait4()
+ * @param child_usage the resources used by the process, as returned by wait4()
+ * @param reaped_at when the process was reaped (CLOCK_MONOTONIC)
+ * @param in_background true if the process was a background process, false otherwise
+ */
+void trace_exit(pid_t pid, int wait_status, const struct rusage *child_usage, struct timespec reaped_at,
+                bool in_background) {
+    if (trace_fd == -1) {
+        return;
+    }
+    begin_trace_record("exit", reaped_at);
+    append_trace_format(",\"pid\":%d,\"background\":%s,\"%s\":%d", pid, in_background ? "true" : "false",
+        WIFSIGNALED(wait_status) ? "signal" : "exit",
+        WIFSIGNALED(wait_status) ? WTERMSIG(wait_status) : WEXITSTATUS(wait_status));
+    append_trace_format(",\"user_us\":%lld,\"sys_us\":%lld,\"max_rss_kb\":%ld",
+        (long long) child_usage->ru_utime.tv_sec * 1000000LL + child_usage->ru_utime.tv_usec,
+        (long long) child_usage->ru_stime.tv_sec * 1000000LL + child_usage->ru_stime.tv_usec,
+        child_usage->ru_maxrss);
+    end_trace_record();
+}
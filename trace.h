@@ -0,0 +1,25 @@
+/*
+ * Author: Donato Quartuccia
+ * Description: Header for public functions of trace.c
+ *              Last Modified: 10/14/2026
+ */
+
+#ifndef SMALLSH_TRACE_H
+#define SMALLSH_TRACE_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "parsers.h"
+
+void init_trace();
+void close_trace();
+void detach_trace();
+bool is_tracing();
+void trace_command(struct command *command);
+void trace_launch(pid_t pid, const char* path, struct timespec launch_time, bool spawned);
+void trace_exit(pid_t pid, int wait_status, const struct rusage *child_usage, struct timespec reaped_at,
+                bool in_background);
+
+#endif //SMALLSH_TRACE_H